@@ -0,0 +1,713 @@
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Gate-level simulator for the chips of projects 01-05.
+// A chip is flattened into Nand gates and DFFs, the gates are sorted into
+// evaluation order once, and every net carries a 64-bit word so that one
+// pass evaluates 64 independent input vectors.
+
+[[noreturn]] void error(const string &msg) {
+  cerr << msg << endl;
+  exit(-1);
+}
+
+// Nand and DFF are the primitives. The other chips the reference simulator
+// provides as Java builtins are expressed with the chips of this repo; the
+// keyboard is never pressed.
+const map<string, string> builtin_sources = {
+    {"Nand", "CHIP Nand { IN a, b; OUT out; PARTS: }"},
+    {"DFF", "CHIP DFF { IN in; OUT out; PARTS: }"},
+    {"ARegister",
+     "CHIP ARegister { IN in[16], load; OUT out[16]; PARTS:"
+     " Register(in=in, load=load, out=out); }"},
+    {"DRegister",
+     "CHIP DRegister { IN in[16], load; OUT out[16]; PARTS:"
+     " Register(in=in, load=load, out=out); }"},
+    {"Screen",
+     "CHIP Screen { IN in[16], load, address[13]; OUT out[16]; PARTS:"
+     " DMux(in=load, sel=address[12], a=l0, b=l1);"
+     " RAM4K(in=in, load=l0, address=address[0..11], out=o0);"
+     " RAM4K(in=in, load=l1, address=address[0..11], out=o1);"
+     " Mux16(a=o0, b=o1, sel=address[12], out=out); }"},
+    {"Keyboard",
+     "CHIP Keyboard { OUT out[16]; PARTS:"
+     " And16(a=false, b=false, out=out); }"},
+};
+
+// name, name[i] or name[i..j]; hi < 0 means the whole bus
+struct Bus {
+  string name;
+  int lo = 0, hi = -1;
+};
+
+struct Connection {
+  Bus pin, signal;
+};
+
+struct Part {
+  string chip;
+  vector<Connection> connections;
+  int line;
+};
+
+struct Chip;
+
+// A connection resolved to offsets: n bits of the part's pins starting at
+// child, wired to the chip's nets starting at local (or a constant)
+struct Link {
+  int child, local, n;
+  bool input;
+};
+
+struct Instance {
+  const Chip *def;
+  vector<Link> links;
+};
+
+// Pins are laid out flat, IN pins then OUT pins; a chip's local nets are
+// its pins followed by its internal signals.
+struct Chip {
+  string name;
+  vector<pair<string, int>> in, out;
+  vector<Part> parts;
+  int pin_width = 0, in_width = 0, local_width = 0;
+  vector<Instance> instances;
+
+  // offset of pin in the flat layout, -1 if there is no such pin
+  int offset(const string &pin, int &width, bool &input) const {
+    int o = 0;
+    for (auto &[n, w] : in) {
+      if (n == pin) return width = w, input = true, o;
+      o += w;
+    }
+    for (auto &[n, w] : out) {
+      if (n == pin) return width = w, input = false, o;
+      o += w;
+    }
+    return -1;
+  }
+};
+
+struct HdlParser {
+  string src, file;
+  size_t i = 0;
+  int line = 1;
+
+  HdlParser(const string &src, const string &file) : src(src), file(file) {}
+
+  void skip() {
+    while (i < src.size()) {
+      if (src[i] == '\n') {
+        line++, i++;
+      } else if (isspace((unsigned char)src[i])) {
+        i++;
+      } else if (src.compare(i, 2, "//") == 0) {
+        while (i < src.size() and src[i] != '\n') i++;
+      } else if (src.compare(i, 2, "/*") == 0) {
+        size_t end = src.find("*/", i + 2);
+        if (end == string::npos) end = src.size();
+        for (; i < end; i++)
+          if (src[i] == '\n') line++;
+        i = min(src.size(), end + 2);
+      } else {
+        break;
+      }
+    }
+  }
+
+  string token() {
+    skip();
+    if (i >= src.size()) return "";
+    if (src.compare(i, 2, "..") == 0) return i += 2, "..";
+    if (isalnum((unsigned char)src[i]) or src[i] == '_' or src[i] == '.') {
+      size_t start = i;
+      while (i < src.size() and
+             (isalnum((unsigned char)src[i]) or src[i] == '_' or
+              (src[i] == '.' and src.compare(i, 2, "..") != 0)))
+        i++;
+      return src.substr(start, i - start);
+    }
+    return string(1, src[i++]);
+  }
+
+  string peek() {
+    size_t saved = i;
+    int saved_line = line;
+    string t = token();
+    i = saved, line = saved_line;
+    return t;
+  }
+
+  void expect(const string &t) {
+    string got = token();
+    if (got != t)
+      error(file + ":" + to_string(line) + ": expected '" + t + "' but got '" +
+            got + "'");
+  }
+
+  void pins(vector<pair<string, int>> &list) {
+    while (true) {
+      string name = token();
+      int width = 1;
+      if (peek() == "[") {
+        token();
+        width = stoi(token());
+        expect("]");
+      }
+      list.emplace_back(name, width);
+      string t = token();
+      if (t == ";") break;
+      if (t != ",") error(file + ":" + to_string(line) + ": bad pin list");
+    }
+  }
+
+  Bus bus() {
+    Bus b;
+    b.name = token();
+    if (peek() == "[") {
+      token();
+      b.lo = b.hi = stoi(token());
+      if (peek() == "..") {
+        token();
+        b.hi = stoi(token());
+      }
+      expect("]");
+    }
+    return b;
+  }
+
+  Chip parse() {
+    Chip chip;
+    expect("CHIP");
+    chip.name = token();
+    expect("{");
+    while (true) {
+      string t = token();
+      if (t == "IN")
+        pins(chip.in);
+      else if (t == "OUT")
+        pins(chip.out);
+      else if (t == "PARTS")
+        break;
+      else
+        error(file + ":" + to_string(line) + ": unsupported '" + t + "'");
+    }
+    expect(":");
+    while (peek() != "}") {
+      Part part;
+      part.line = line;
+      part.chip = token();
+      expect("(");
+      while (true) {
+        Connection c;
+        c.pin = bus();
+        expect("=");
+        c.signal = bus();
+        part.connections.emplace_back(c);
+        string t = token();
+        if (t == ")") break;
+        if (t != ",") error(file + ":" + to_string(line) + ": bad part");
+      }
+      expect(";");
+      chip.parts.emplace_back(part);
+    }
+    return chip;
+  }
+};
+
+// Finds .hdl files by chip name; directories added first take precedence
+struct Library {
+  map<string, string> paths;
+  map<string, Chip> chips;
+
+  void add_dir(const filesystem::path &dir, bool recursive) {
+    error_code ec;
+    auto add = [&](const filesystem::path &p) {
+      if (p.extension() == ".hdl") paths.emplace(p.stem().string(), p.string());
+    };
+    if (recursive) {
+      for (auto &e : filesystem::recursive_directory_iterator(dir, ec))
+        add(e.path());
+    } else {
+      for (auto &e : filesystem::directory_iterator(dir, ec)) add(e.path());
+    }
+  }
+
+  const Chip &get(const string &name) {
+    auto it = chips.find(name);
+    if (it != chips.end()) return it->second;
+
+    string src, file;
+    if (paths.count(name)) {
+      file = paths[name];
+      ifstream ifs(file);
+      stringstream ss;
+      ss << ifs.rdbuf();
+      src = ss.str();
+    } else if (builtin_sources.count(name)) {
+      file = "<builtin " + name + ">";
+      src = builtin_sources.at(name);
+    } else {
+      error("Chip " + name + " not found");
+    }
+    Chip &chip = chips[name] = HdlParser(src, file).parse();
+    compile(chip);
+    return chip;
+  }
+
+  // Resolves every part and connection once per chip definition, so that
+  // instantiating the chip only copies nets around.
+  void compile(Chip &chip) {
+    for (auto &[n, w] : chip.in) chip.in_width += w;
+    chip.pin_width = chip.in_width;
+    for (auto &[n, w] : chip.out) chip.pin_width += w;
+
+    map<string, pair<int, int>> signals;  // name -> offset, width
+    int offset = 0;
+    for (auto &[n, w] : chip.in) signals[n] = {offset, w}, offset += w;
+    for (auto &[n, w] : chip.out) signals[n] = {offset, w}, offset += w;
+    chip.local_width = chip.pin_width;
+
+    auto fail = [&](const Part &part, const string &msg) {
+      error(chip.name + ": line " + to_string(part.line) + ": " + msg);
+    };
+
+    // internal signals take the width of the part output driving them
+    for (auto &part : chip.parts) {
+      const Chip &def = get(part.chip);
+      for (auto &c : part.connections) {
+        int w = 0;
+        bool input = false;
+        if (def.offset(c.pin.name, w, input) < 0)
+          fail(part, part.chip + " has no pin " + c.pin.name);
+        if (input or signals.count(c.signal.name)) continue;
+        if (c.signal.hi >= 0)
+          fail(part, "sub bus of internal pin " + c.signal.name);
+        int n = c.pin.hi < 0 ? w : c.pin.hi - c.pin.lo + 1;
+        signals[c.signal.name] = {chip.local_width, n};
+        chip.local_width += n;
+      }
+    }
+
+    for (auto &part : chip.parts) {
+      Instance inst{&get(part.chip), {}};
+      for (auto &c : part.connections) {
+        int w = 0;
+        bool input = false;
+        int offset = inst.def->offset(c.pin.name, w, input);
+        int plo = c.pin.lo, phi = c.pin.hi < 0 ? w - 1 : c.pin.hi;
+        int n = phi - plo + 1;
+        if (plo < 0 or phi >= w or n <= 0)
+          fail(part, "bad sub bus of " + c.pin.name);
+
+        const string &s = c.signal.name;
+        if (s == "true" or s == "false") {
+          if (!input) fail(part, "output connected to a constant");
+          int constant = s == "true" ? -2 : -1;
+          inst.links.push_back({offset + plo, constant, n, true});
+          continue;
+        }
+        if (!signals.count(s)) fail(part, "pin " + s + " is never driven");
+        auto [base, width] = signals[s];
+        int slo = c.signal.lo;
+        int shi = c.signal.hi < 0 ? width - 1 : c.signal.hi;
+        if (shi - slo + 1 != n or slo < 0 or shi >= width)
+          fail(part, "width mismatch between " + c.pin.name + " and " + s);
+        inst.links.push_back({offset + plo, base + slo, n, input});
+      }
+      chip.instances.emplace_back(inst);
+    }
+  }
+};
+
+struct Nand {
+  int a, b, out;
+};
+
+struct Dff {
+  int in, out;
+};
+
+enum { FALSE_NET, TRUE_NET };
+
+// Flattens a chip hierarchy into Nand gates and DFFs over numbered nets.
+// Nets connected through part outputs are merged with union-find.
+struct Netlist {
+  Library &lib;
+  vector<int> parent = {FALSE_NET, TRUE_NET};
+  vector<Nand> nands;
+  vector<Dff> dffs;
+
+  Netlist(Library &lib) : lib(lib) {}
+
+  int new_net() {
+    parent.emplace_back(parent.size());
+    return parent.size() - 1;
+  }
+
+  int find(int x) {
+    while (parent[x] != x) x = parent[x] = parent[parent[x]];
+    return x;
+  }
+
+  void merge(int driver, int net) {
+    driver = find(driver), net = find(net);
+    if (driver == net) return;
+    if (net == FALSE_NET or net == TRUE_NET) swap(driver, net);
+    parent[net] = driver;
+  }
+
+  // pins holds the nets of chip's flat pin layout
+  void instantiate(const Chip &chip, const int *pins) {
+    if (chip.name == "Nand") {
+      nands.push_back({pins[0], pins[1], pins[2]});
+      return;
+    }
+    if (chip.name == "DFF") {
+      dffs.push_back({pins[0], pins[1]});
+      return;
+    }
+
+    vector<int> local(pins, pins + chip.pin_width), child;
+    for (int k = chip.pin_width; k < chip.local_width; k++)
+      local.emplace_back(new_net());
+
+    for (auto &inst : chip.instances) {
+      const Chip &def = *inst.def;
+      child.assign(def.pin_width, FALSE_NET);
+      for (int k = def.in_width; k < def.pin_width; k++) child[k] = new_net();
+      for (auto &l : inst.links) {
+        if (!l.input) continue;
+        for (int k = 0; k < l.n; k++)
+          child[l.child + k] = l.local == -2   ? TRUE_NET
+                               : l.local == -1 ? FALSE_NET
+                                               : local[l.local + k];
+      }
+
+      instantiate(def, child.data());
+      for (auto &l : inst.links)
+        if (!l.input)
+          for (int k = 0; k < l.n; k++)
+            merge(child[l.child + k], local[l.local + k]);
+    }
+  }
+};
+
+// The flattened chip in evaluation order. Gate i writes net first_gate + i,
+// so one pass over a, b computes every net from its inputs.
+struct Kernel {
+  int nets, first_gate, levels = 0;
+  vector<uint32_t> a, b;
+  vector<Dff> dffs;
+  map<string, vector<int>> in, out;
+  vector<uint64_t> value, latched;
+
+  Kernel(Netlist &net, const Chip &chip, const vector<int> &pins) {
+    int n = net.parent.size();
+    vector<int> driver(n, -1);
+    for (size_t g = 0; g < net.nands.size(); g++) {
+      auto &nand = net.nands[g];
+      nand = {net.find(nand.a), net.find(nand.b), net.find(nand.out)};
+      driver[nand.out] = g;
+    }
+    for (auto &d : net.dffs) d = {net.find(d.in), net.find(d.out)};
+
+    // sources (inputs, constants, DFF outputs, undriven nets) come first
+    vector<int> id(n, -1), level(n, 0);
+    int next = 0;
+    id[FALSE_NET] = next++;
+    id[TRUE_NET] = next++;
+    for (int k = 0; k < chip.in_width; k++) {
+      int x = net.find(pins[k]);
+      if (id[x] < 0) id[x] = next++;
+    }
+    for (auto &d : net.dffs)
+      if (id[d.out] < 0) id[d.out] = next++;
+    for (int x = 0; x < n; x++)
+      if (net.find(x) == x and driver[x] < 0 and id[x] < 0) id[x] = next++;
+    first_gate = next;
+
+    // Kahn's algorithm over gate inputs, fanout lists stored flat
+    int gates = net.nands.size();
+    vector<int> start(n + 1, 0), fanout(2 * gates), pending(gates, 0), order;
+    for (auto &nand : net.nands)
+      for (int x : {nand.a, nand.b})
+        if (driver[x] >= 0) start[x + 1]++;
+    for (int x = 0; x < n; x++) start[x + 1] += start[x];
+    vector<int> fill(start.begin(), start.end() - 1);
+    for (int g = 0; g < gates; g++) {
+      for (int x : {net.nands[g].a, net.nands[g].b}) {
+        if (driver[x] >= 0) {
+          pending[g]++;
+          fanout[fill[x]++] = g;
+        }
+      }
+      if (pending[g] == 0) order.emplace_back(g);
+    }
+    for (size_t k = 0; k < order.size(); k++) {
+      auto &nand = net.nands[order[k]];
+      level[nand.out] = max(level[nand.a], level[nand.b]) + 1;
+      levels = max(levels, level[nand.out]);
+      id[nand.out] = next++;
+      for (int f = start[nand.out]; f < start[nand.out + 1]; f++)
+        if (--pending[fanout[f]] == 0) order.emplace_back(fanout[f]);
+    }
+    if (order.size() != net.nands.size())
+      error(chip.name + ": combinational loop");
+
+    nets = next;
+    for (int g : order) {
+      a.emplace_back(id[net.nands[g].a]);
+      b.emplace_back(id[net.nands[g].b]);
+    }
+    for (auto &d : net.dffs) dffs.push_back({id[d.in], id[d.out]});
+    int k = 0;
+    for (auto &[name, w] : chip.in)
+      for (int i = 0; i < w; i++)
+        in[name].emplace_back(id[net.find(pins[k++])]);
+    for (auto &[name, w] : chip.out)
+      for (int i = 0; i < w; i++)
+        out[name].emplace_back(id[net.find(pins[k++])]);
+
+    value.assign(nets, 0);
+    value[id[TRUE_NET]] = ~0ull;
+    latched.assign(dffs.size(), 0);
+  }
+
+  void eval() {
+    uint64_t *v = value.data();
+    const uint32_t *pa = a.data(), *pb = b.data();
+    for (size_t g = 0, size = a.size(); g < size; g++)
+      v[first_gate + g] = ~(v[pa[g]] & v[pb[g]]);
+  }
+
+  // DFFs sample their inputs on tick and show them on tock
+  void tick() {
+    for (size_t i = 0; i < dffs.size(); i++) latched[i] = value[dffs[i].in];
+  }
+
+  void tock() {
+    for (size_t i = 0; i < dffs.size(); i++) value[dffs[i].out] = latched[i];
+  }
+};
+
+vector<string> split_row(const string &line) {
+  vector<string> cells;
+  stringstream ss(line);
+  string cell;
+  getline(ss, cell, '|');
+  while (getline(ss, cell, '|')) {
+    size_t b = cell.find_first_not_of(" \t\r");
+    size_t e = cell.find_last_not_of(" \t\r");
+    cells.emplace_back(b == string::npos ? "" : cell.substr(b, e - b + 1));
+  }
+  if (!cells.empty() and cells.back().empty()) cells.pop_back();
+  return cells;
+}
+
+// binary when every digit is 0/1 and there is one per bit, else decimal
+bool parse_value(const string &s, int width, int64_t &v) {
+  if (s.empty() or s.find('*') != string::npos) return false;
+  if (s.size() == (size_t)width and s.find_first_not_of("01") == string::npos) {
+    v = stoll(s, nullptr, 2);
+  } else {
+    v = stoll(s);
+  }
+  return true;
+}
+
+// Runs the rows of a .cmp file against the chip. Rows of a combinational
+// chip are packed 64 to a pass; a "time" column makes the run sequential.
+bool compare(Kernel &k, const string &cmpfile, int &rows) {
+  ifstream ifs(cmpfile);
+  if (!ifs) error("Cannot open " + cmpfile);
+  string line;
+  getline(ifs, line);
+  auto header = split_row(line);
+  vector<string> lines;
+  while (getline(ifs, line))
+    if (line.find('|') != string::npos) lines.emplace_back(line);
+  rows = lines.size();
+
+  bool sequential = !header.empty() and header[0] == "time";
+  for (auto &h : header)
+    if (h != "time" and !k.in.count(h) and !k.out.count(h))
+      cerr << "Ignoring column " << h << endl;
+
+  int batch = sequential ? 1 : 64;
+  for (int r0 = 0; r0 < rows; r0 += batch) {
+    int n = min(batch, rows - r0);
+    vector<vector<string>> cells;
+    for (int r = 0; r < n; r++) cells.emplace_back(split_row(lines[r0 + r]));
+
+    for (size_t c = 0; c < header.size(); c++) {
+      if (!k.in.count(header[c])) continue;
+      auto &nets = k.in[header[c]];
+      for (size_t bit = 0; bit < nets.size(); bit++) {
+        uint64_t word = 0;
+        for (int r = 0; r < n; r++) {
+          int64_t v;
+          if (c < cells[r].size() and parse_value(cells[r][c], nets.size(), v))
+            word |= uint64_t(v >> bit & 1) << r;
+        }
+        k.value[nets[bit]] = sequential ? (word & 1 ? ~0ull : 0) : word;
+      }
+    }
+
+    if (sequential) {
+      bool tick = cells[0][0].find('+') != string::npos;
+      if (!tick) k.tock();
+      k.eval();
+      if (tick) k.tick();
+    } else {
+      k.eval();
+    }
+
+    for (size_t c = 0; c < header.size(); c++) {
+      if (!k.out.count(header[c])) continue;
+      auto &nets = k.out[header[c]];
+      for (int r = 0; r < n; r++) {
+        int64_t expected;
+        if (c >= cells[r].size() or
+            !parse_value(cells[r][c], nets.size(), expected))
+          continue;
+        int64_t got = 0;
+        for (size_t bit = 0; bit < nets.size(); bit++)
+          got |= int64_t(k.value[nets[bit]] >> r & 1) << bit;
+        uint64_t mask = nets.size() >= 64 ? ~0ull : (1ull << nets.size()) - 1;
+        if ((got ^ expected) & mask) {
+          if (nets.size() == 16 and got >= 32768) got -= 65536;
+          cout << "Comparison failure at line " << r0 + r + 2 << ": "
+               << header[c] << " is " << got << ", expected "
+               << cells[r][c] << endl;
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// exhaustive truth table of a combinational chip, in .cmp format
+void table(Kernel &k, const Chip &chip) {
+  int bits = 0;
+  for (auto &[n, w] : chip.in) bits += w;
+  if (bits > 24) error("Too many input bits for a truth table");
+  if (!k.dffs.empty()) error("Truth tables need a combinational chip");
+
+  auto column = [](const string &name, int w) {
+    int width = max<int>(name.size(), w) + 2;
+    int left = (width - name.size()) / 2;
+    return string(left, ' ') + name + string(width - left - name.size(), ' ');
+  };
+  auto cell = [](int64_t v, int w, const string &name) {
+    string s;
+    for (int i = w - 1; i >= 0; i--) s += char('0' + (v >> i & 1));
+    int width = max<int>(name.size(), w) + 2;
+    int left = (width - w) / 2;
+    return string(left, ' ') + s + string(width - left - w, ' ');
+  };
+
+  cout << "|";
+  for (auto &[n, w] : chip.in) cout << column(n, w) << "|";
+  for (auto &[n, w] : chip.out) cout << column(n, w) << "|";
+  cout << "\n";
+
+  uint64_t total = 1ull << bits;
+  for (uint64_t base = 0; base < total; base += 64) {
+    int n = min<uint64_t>(64, total - base);
+    int bit = 0;
+    for (auto &[name, w] : chip.in) {
+      for (int i = 0; i < w; i++, bit++) {
+        uint64_t word = 0;
+        for (int r = 0; r < n; r++) word |= ((base + r) >> bit & 1) << r;
+        k.value[k.in[name][i]] = word;
+      }
+    }
+    k.eval();
+    for (int r = 0; r < n; r++) {
+      cout << "|";
+      int shift = 0;
+      for (auto &[name, w] : chip.in) {
+        cout << cell((base + r) >> shift, w, name) << "|";
+        shift += w;
+      }
+      for (auto &[name, w] : chip.out) {
+        int64_t v = 0;
+        for (int i = 0; i < w; i++)
+          v |= int64_t(k.value[k.out[name][i]] >> r & 1) << i;
+        cout << cell(v, w, name) << "|";
+      }
+      cout << "\n";
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  string hdlfile, cmpfile;
+  bool print_table = false;
+  vector<string> dirs;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg.substr(0, 10) == "--compare=")
+      cmpfile = arg.substr(10);
+    else if (arg.substr(0, 7) == "--path=")
+      dirs.emplace_back(arg.substr(7));
+    else if (arg == "--table")
+      print_table = true;
+    else
+      hdlfile = arg;
+  }
+  if (hdlfile.empty()) {
+    // chips are looked up next to the given one, below each --path and
+    // below the current directory
+    cout << "Usage: HardwareSimulator [--path=DIR]... [--compare=file.cmp]"
+            " [--table] chip(.hdl)"
+         << endl;
+    return -1;
+  }
+
+  auto start = chrono::steady_clock::now();
+  Library lib;
+  filesystem::path chipdir = filesystem::absolute(hdlfile).parent_path();
+  lib.add_dir(chipdir, false);
+  for (auto &d : dirs) lib.add_dir(d, true);
+  lib.add_dir(filesystem::current_path(), true);
+  lib.paths[filesystem::path(hdlfile).stem().string()] = hdlfile;
+
+  const Chip &chip = lib.get(filesystem::path(hdlfile).stem().string());
+  Netlist net(lib);
+  vector<int> pins;
+  for (int k = 0; k < chip.pin_width; k++) pins.emplace_back(net.new_net());
+  net.instantiate(chip, pins.data());
+  Kernel kernel(net, chip, pins);
+  double build = chrono::duration<double, milli>(chrono::steady_clock::now() -
+                                                 start)
+                     .count();
+  cerr << chip.name << ": " << kernel.a.size() << " Nand, "
+       << kernel.dffs.size() << " DFF, " << kernel.levels << " levels ("
+       << build << " ms to build)" << endl;
+
+  int ret = 0;
+  if (!cmpfile.empty()) {
+    start = chrono::steady_clock::now();
+    int rows;
+    bool ok = compare(kernel, cmpfile, rows);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() -
+                                                start)
+                    .count();
+    if (ok) cout << "End of script - Comparison ended successfully" << endl;
+    cerr << rows << " rows in " << ms << " ms" << endl;
+    ret = ok ? 0 : 1;
+  }
+  if (print_table) table(kernel, chip);
+  return ret;
+}
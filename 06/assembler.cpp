@@ -1,256 +1,322 @@
-#include <algorithm>
-#include <fstream>
-#include <iostream>
-#include <map>
-#include <string>
-#include <vector>
-using namespace std;
-
-// delete Spaces, tabs, <CR>s, and comments
-string formatLine(const string line) {
-  int n = line.size();
-  string ret = "";
-  for (int i = 0; i < n; i++) {
-    if (i + 1 < n and line.substr(i, 2) == "//") break;
-    if (line[i] == ' ') continue;
-    if (line[i] == '\t') continue;
-    if (line[i] == '\r') continue;
-    ret += line[i];
-  }
-  return ret;
-}
-
-// If dest is "@", it would be A-instruction
-// otherwise, C-instruction
-struct Statement {
-  string dest, comp, jump;
-  Statement() : dest(""), comp(""), jump("") {}
-  Statement(string dest, string comp, string jump)
-      : dest(dest), comp(comp), jump(jump) {}
-};
-
-string dec2bin(int x) {
-  string ret = "";
-  while (x) {
-    ret += char(x % 2 + '0');
-    x /= 2;
-  }
-  for (int i = ret.size(); i < 16; i++) ret += "0";
-  reverse(ret.begin(), ret.end());
-  return ret;
-}
-
-struct Symbols {
-  int next;
-  map<string, int> table;
-
-  Symbols() {
-    next = 16;
-    for (int i = 0; i < 16; i++) {
-      string symbol = "R" + to_string(i);
-      table[symbol] = i;
-    }
-
-    table["SP"] = 0;
-    table["LCL"] = 1;
-    table["ARG"] = 2;
-    table["THIS"] = 3;
-    table["THAT"] = 4;
-    table["SCREEN"] = 16384;
-    table["KBD"] = 24576;
-  }
-
-  void add(string symbol) { table[symbol] = next++; }
-
-  void set(string symbol, int val) { table[symbol] = val; }
-
-  string bin(string symbol) { return dec2bin(table[symbol]); }
-
-  bool exist(string symbol) { return table.count(symbol) > 0; }
-};
-
-bool hasChar(string s) {
-  for (auto c : s) {
-    if ('a' <= c and c <= 'z') return true;
-    if ('A' <= c and c <= 'Z') return true;
-  }
-  return false;
-}
-
-vector<Statement> parse(vector<string> &program, Symbols &symbols) {
-  vector<Statement> ret;
-  for (auto line : program) {
-    line = formatLine(line);
-    if (line.empty()) continue;
-
-    // If line starts with "@"
-    if (line[0] == '@') {
-      string symbol = line.substr(1, line.size() - 1);
-      if (hasChar(symbol)) {
-        ret.emplace_back("@", "symbol", symbol);
-      } else {
-        // immediate
-        int val = stoi(symbol);
-        ret.emplace_back("@", "imm", dec2bin(val));
-      }
-    } else if (line[0] == '(') {
-      string symbol = line.substr(1, line.size() - 2);
-      symbols.set(symbol, ret.size());
-    } else {
-      int phase = 0;  // 0:dest, 1:comp, 2:jump
-      Statement s;
-      for (auto c : line) {
-        if (c == '=') {
-          phase = 1;
-          continue;
-        }
-        if (c == ';') {
-          phase = 2;
-          continue;
-        }
-
-        if (phase == 0) {
-          s.dest += c;
-        } else if (phase == 1) {
-          s.comp += c;
-        } else {
-          s.jump += c;
-        }
-      }
-      if (s.comp.empty()) swap(s.dest, s.comp);
-      ret.emplace_back(s);
-    }
-  }
-  return ret;
-}
-
-string codegen_c(Statement &s) {
-  string a = "0", c = "101010", d = "000", j = "000";
-
-  // set a-bit and replace 'M' with 'A'
-  for (auto &c : s.comp) {
-    if (c == 'M') {
-      a = "1";
-      c = 'A';
-    }
-  }
-
-  // set c-bits
-  if (s.comp == "0")
-    c = "101010";
-  else if (s.comp == "1")
-    c = "111111";
-  else if (s.comp == "-1")
-    c = "111010";
-  else if (s.comp == "D")
-    c = "001100";
-  else if (s.comp == "A")
-    c = "110000";
-  else if (s.comp == "!D")
-    c = "001101";
-  else if (s.comp == "!A")
-    c = "110001";
-  else if (s.comp == "-D")
-    c = "001111";
-  else if (s.comp == "-A")
-    c = "110011";
-  else if (s.comp == "D+1")
-    c = "011111";
-  else if (s.comp == "A+1")
-    c = "110111";
-  else if (s.comp == "D-1")
-    c = "001110";
-  else if (s.comp == "A-1")
-    c = "110010";
-  else if (s.comp == "D+A")
-    c = "000010";
-  else if (s.comp == "D-A")
-    c = "010011";
-  else if (s.comp == "A-D")
-    c = "000111";
-  else if (s.comp == "D&A")
-    c = "000000";
-  else if (s.comp == "D|A")
-    c = "010101";
-
-  // set d-bits
-  string dlist = "AMD";
-  int ilist[] = {0, 2, 1};
-  for (int i = 0; i < dlist.size(); i++) {
-    if (*s.dest.begin() == dlist[i]) {
-      d[ilist[i]] = '1';
-      s.dest.erase(s.dest.begin());
-    }
-  }
-
-  // set j-bits
-  if (s.jump == "JGT")
-    j = "001";
-  else if (s.jump == "JEQ")
-    j = "010";
-  else if (s.jump == "JGE")
-    j = "011";
-  else if (s.jump == "JLT")
-    j = "100";
-  else if (s.jump == "JNE")
-    j = "101";
-  else if (s.jump == "JLE")
-    j = "110";
-  else if (s.jump == "JMP")
-    j = "111";
-
-  return "111" + a + c + d + j;
-}
-
-void codegen(const string outfile, vector<Statement> &statements,
-             Symbols &symbols) {
-  ofstream ofs(outfile);
-  for (auto s : statements) {
-    // A-instructions
-    if (s.dest == "@") {
-      if (s.comp == "imm") {
-        ofs << s.jump << endl;
-      } else {
-        if (!symbols.exist(s.jump)) symbols.add(s.jump);
-        ofs << symbols.bin(s.jump) << endl;
-      }
-    } else {
-      // C-instructions
-      ofs << codegen_c(s) << endl;
-    }
-  }
-}
-
-int main(int argc, char *args[]) {
-  if (argc != 2) {
-    cout << "Need filename(.asm)" << endl;
-    return -1;
-  }
-
-  string filename = args[1];
-  ifstream ifs(filename);
-  vector<string> program;
-  string s;
-  while (getline(ifs, s)) {
-    program.emplace_back(s);
-  }
-
-  Symbols symbols;
-  vector<Statement> statements = parse(program, symbols);
-
-  string outfile = filename.substr(0, filename.size() - 4) + ".hack";
-  codegen(outfile, statements, symbols);
-
-  // Debug
-  /*
-  for(auto s : statements){
-    cout << s.dest << ", " << s.comp << ", " << s.jump << endl;
-  }
-  cout << endl;
-  for (auto s : symbols.table) {
-    cout << s.first << ":" << s.second << endl;
-  }
-  */
-
-  return 0;
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+#include "../common/Hack.h"
+#include "../common/MappedFile.h"
+#include "../common/OutputBuffer.h"
+#include "../common/Parallel.h"
+
+bool is_space(char c) { return c == ' ' or c == '\t' or c == '\r'; }
+
+// drop comments and surrounding spaces, tabs and <CR>s
+string_view trim(string_view line) {
+  size_t comment = line.find("//");
+  if (comment != string_view::npos) line = line.substr(0, comment);
+  while (!line.empty() and is_space(line.front())) line.remove_prefix(1);
+  while (!line.empty() and is_space(line.back())) line.remove_suffix(1);
+  return line;
+}
+
+// A-instructions carry an immediate value or a symbol,
+// C-instructions carry dest, comp and jump.
+// Every string_view points into the mapped source file.
+struct Statement {
+  enum Type { Imm, Symbol, Comp };
+  Type type;
+  int imm = 0, id = -1;
+  string_view dest, comp, jump;
+};
+
+// Interned symbol table. Every distinct name is copied once into the
+// names arena and gets a small integer id; statements keep the id, so
+// resolving a reference is a single index into value.
+struct Symbols {
+  struct Name {
+    uint32_t offset, size;
+    uint64_t hash;
+  };
+
+  int next;
+  string names;           // arena holding every interned name
+  vector<Name> ids;       // id -> name in the arena
+  vector<int> value;      // id -> address, -1 until bound
+  vector<int> slots;      // open addressing table of ids, -1 is empty
+
+  Symbols(bool predefined = true) : next(16), slots(1024, -1) {
+    if (!predefined) return;
+    for (auto &p : ::predefined) set(intern(p.name), p.address);
+  }
+
+  static uint64_t hash(string_view s) {
+    uint64_t h = 14695981039346656037ull;  // FNV-1a
+    for (unsigned char c : s) h = (h ^ c) * 1099511628211ull;
+    return h;
+  }
+
+  string_view name(int id) const {
+    return string_view(names).substr(ids[id].offset, ids[id].size);
+  }
+
+  // returns the id of symbol, adding it unbound on first sight
+  int intern(string_view symbol) {
+    uint64_t h = hash(symbol);
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    for (; slots[i] >= 0; i = (i + 1) & mask) {
+      int id = slots[i];
+      if (ids[id].hash == h and name(id) == symbol) return id;
+    }
+
+    int id = ids.size();
+    ids.push_back({(uint32_t)names.size(), (uint32_t)symbol.size(), h});
+    names += symbol;
+    value.push_back(-1);
+    slots[i] = id;
+    if (ids.size() * 2 > slots.size()) grow();
+    return id;
+  }
+
+  void grow() {
+    vector<int> old(slots.size() * 2, -1);
+    swap(slots, old);
+    size_t mask = slots.size() - 1;
+    for (int id : old) {
+      if (id < 0) continue;
+      size_t i = ids[id].hash & mask;
+      while (slots[i] >= 0) i = (i + 1) & mask;
+      slots[i] = id;
+    }
+  }
+
+  void set(int id, int val) { value[id] = val; }
+
+  // address of id; unbound symbols become variables from RAM[16] on
+  int get(int id) {
+    if (value[id] < 0) value[id] = next++;
+    return value[id];
+  }
+};
+
+bool hasChar(string_view s) {
+  for (auto c : s) {
+    if ('a' <= c and c <= 'z') return true;
+    if ('A' <= c and c <= 'Z') return true;
+  }
+  return false;
+}
+
+// Single pass over the source text: labels are bound as they are seen and
+// every other line becomes a Statement viewing the original bytes.
+vector<Statement> parse(string_view text, Symbols &symbols) {
+  vector<Statement> ret;
+  while (!text.empty()) {
+    size_t eol = text.find('\n');
+    string_view line = trim(text.substr(0, eol));
+    text.remove_prefix(eol == string_view::npos ? text.size() : eol + 1);
+    if (line.empty()) continue;
+
+    // If line starts with "@"
+    if (line[0] == '@') {
+      Statement s;
+      string_view symbol = trim(line.substr(1));
+      if (hasChar(symbol)) {
+        s.type = Statement::Symbol;
+        s.id = symbols.intern(symbol);
+      } else {
+        // immediate
+        s.type = Statement::Imm;
+        from_chars(symbol.data(), symbol.data() + symbol.size(), s.imm);
+      }
+      ret.emplace_back(s);
+    } else if (line[0] == '(') {
+      string_view symbol = trim(line.substr(1, line.find(')') - 1));
+      symbols.set(symbols.intern(symbol), ret.size());
+    } else {
+      Statement s;
+      s.type = Statement::Comp;
+      size_t eq = line.find('='), semi = line.find(';');
+      if (semi != string_view::npos) {
+        s.jump = line.substr(semi + 1);
+        line = line.substr(0, semi);
+      }
+      if (eq != string_view::npos) {
+        s.dest = line.substr(0, eq);
+        line = line.substr(eq + 1);
+      }
+      s.comp = line;
+      ret.emplace_back(s);
+    }
+  }
+  return ret;
+}
+
+// returns the 16-bit word, or -1 if any field is not a valid mnemonic
+int codegen_c(const Statement &s) {
+  return encode_c(s.dest, s.comp, s.jump);
+}
+
+// A slice of the source that ends on a line boundary. Chunks are parsed
+// and encoded independently; only symbol resolution is done serially.
+struct Chunk {
+  string_view text;
+  Symbols symbols{false};  // chunk-local ids, labels relative to the chunk
+  vector<Statement> statements;
+  vector<int> address;  // local id -> resolved address
+  int offset = 0;       // index of the chunk's first word in the program
+};
+
+vector<Chunk> split(string_view text, int jobs) {
+  vector<Chunk> chunks;
+  size_t size = text.size() / jobs + 1;
+  while (!text.empty()) {
+    size_t eol = text.find('\n', min(size, text.size() - 1));
+    size_t n = eol == string_view::npos ? text.size() : eol + 1;
+    chunks.emplace_back();
+    chunks.back().text = text.substr(0, n);
+    text.remove_prefix(n);
+  }
+  return chunks;
+}
+
+// Bind labels and allocate variables exactly as a serial pass would:
+// the last definition of a label wins, and variables get addresses in
+// order of their first reference.
+void resolve(vector<Chunk> &chunks, Symbols &symbols) {
+  int offset = 0;
+  for (auto &chunk : chunks) {
+    chunk.offset = offset;
+    offset += chunk.statements.size();
+    auto &local = chunk.symbols;
+    for (size_t id = 0; id < local.ids.size(); id++)
+      if (local.value[id] >= 0)
+        symbols.set(symbols.intern(local.name(id)),
+                    local.value[id] + chunk.offset);
+  }
+
+  // local ids are numbered by first occurrence, and the first occurrence
+  // of a symbol that is not a label is a reference
+  for (auto &chunk : chunks) {
+    auto &local = chunk.symbols;
+    chunk.address.resize(local.ids.size());
+    for (size_t id = 0; id < local.ids.size(); id++)
+      chunk.address[id] = symbols.get(symbols.intern(local.name(id)));
+  }
+}
+
+bool codegen(Chunk &chunk, vector<uint16_t> &program) {
+  uint16_t *out = program.data() + chunk.offset;
+  for (auto &s : chunk.statements) {
+    // A-instructions
+    if (s.type == Statement::Imm) {
+      *out++ = s.imm;
+    } else if (s.type == Statement::Symbol) {
+      *out++ = chunk.address[s.id];
+    } else {
+      // C-instructions
+      int word = codegen_c(s);
+      if (word < 0) {
+        cerr << "Invalid instruction: " << s.dest << "=" << s.comp << ";"
+             << s.jump << endl;
+        return false;
+      }
+      *out++ = word;
+    }
+  }
+  return true;
+}
+
+// Parse and encode each chunk on its own thread. The result is the same
+// for any number of jobs.
+bool assemble(string_view text, int jobs, vector<uint16_t> &program) {
+  auto chunks = split(text, jobs);
+  parallel(chunks.size(), jobs, [&](int i) {
+    chunks[i].statements = parse(chunks[i].text, chunks[i].symbols);
+  });
+
+  Symbols symbols;
+  resolve(chunks, symbols);
+
+  size_t size = 0;
+  for (auto &chunk : chunks) size += chunk.statements.size();
+  program.resize(size);
+
+  vector<char> ok(chunks.size());
+  parallel(chunks.size(), jobs,
+           [&](int i) { ok[i] = codegen(chunks[i], program); });
+  for (auto c : ok)
+    if (!c) return false;
+  return true;
+}
+
+// one line of 16 '0'/'1' characters per word
+bool write_text(const string outfile, const vector<uint16_t> &program,
+                int jobs) {
+  string buf(program.size() * 17, '\n');
+  size_t block = program.size() / jobs + 1;
+  parallel(jobs, jobs, [&](int b) {
+    size_t end = min(program.size(), (b + 1) * block);
+    for (size_t k = b * block; k < end; k++) {
+      char *p = buf.data() + k * 17;
+      for (int i = 15; i >= 0; i--) *p++ = '0' + (program[k] >> i & 1);
+    }
+  });
+  OutputBuffer out(outfile);
+  out << buf;
+  return out.close();
+}
+
+// raw little-endian image, two bytes per word
+bool write_bin(const string outfile, const vector<uint16_t> &program) {
+  string buf(program.size() * 2, '\0');
+  for (size_t i = 0; i < program.size(); i++) {
+    buf[2 * i] = program[i] & 0xff;
+    buf[2 * i + 1] = program[i] >> 8;
+  }
+  OutputBuffer out(outfile);
+  out << buf;
+  return out.close();
+}
+
+int main(int argc, char *args[]) {
+  string filename, format = "text";
+  int jobs = 1;
+  for (int i = 1; i < argc; i++) {
+    string arg = args[i];
+    if (arg.substr(0, 9) == "--format=")
+      format = arg.substr(9);
+    else if (arg.substr(0, 7) == "--jobs=")
+      jobs = max(1, atoi(arg.c_str() + 7));
+    else
+      filename = arg;
+  }
+  if (filename.empty() or (format != "text" and format != "bin")) {
+    cout << "Usage: assembler [--format=text|bin] [--jobs=N] filename(.asm)"
+         << endl;
+    return -1;
+  }
+
+  MappedFile source(filename);
+  if (!source.ok) {
+    cout << "Cannot open " << filename << endl;
+    return -1;
+  }
+
+  vector<uint16_t> program;
+  if (!assemble(source.text(), jobs, program)) return -1;
+
+  string basename = filename.substr(0, filename.size() - 4);
+  string outfile = basename + (format == "bin" ? ".bin" : ".hack");
+  bool written = format == "bin" ? write_bin(outfile, program)
+                                 : write_text(outfile, program, jobs);
+  if (!written) {
+    cout << "Cannot write " << outfile << endl;
+    return -1;
+  }
+
+  return 0;
 }
\ No newline at end of file
@@ -0,0 +1,58 @@
+#!/bin/bash
+# Times C-instruction encoding: assembles a program of N C-instructions,
+# every dest/comp/jump combination in turn, with this tree's assembler and
+# with the one at REV (the first commit by default), and checks that both
+# write the same .hack.
+# usage: bench_encode.sh [N] [REV]
+set -u
+cd "$(dirname "$0")"
+n=${1:-2000000}
+rev=${2:-$(git rev-list --max-parents=0 HEAD)}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+mkdir "$dir/base" "$dir/new" "$dir/src"
+git -C .. archive "$rev" | tar -x -C "$dir/src" || exit 1
+g++ -std=c++17 -O2 -pthread "$dir/src/06/assembler.cpp" -o "$dir/base/asm" ||
+  exit 1
+g++ -std=c++17 -O2 -pthread assembler.cpp -o "$dir/new/asm" || exit 1
+
+awk -v n="$n" 'BEGIN {
+  split("0 1 -1 D A !D !A -D -A D+1 A+1 D-1 A-1 D+A D-A A-D D&A D|A " \
+        "M !M -M M+1 M-1 D+M D-M M-D D&M D|M", comp, " ")
+  split("M D MD A AM AD AMD", dest, " ")
+  split("JGT JEQ JGE JLT JNE JLE JMP", jump, " ")
+  for (i = 0; i < n; i++) {
+    c = comp[i % 28 + 1]
+    k = int(i / 28) % 15
+    if (k < 7) print dest[k + 1] "=" c
+    else if (k < 14) print c ";" jump[k - 6]
+    else print "M=" c ";JMP"
+  }
+}' > "$dir/Encode.asm"
+cp "$dir/Encode.asm" "$dir/base/"
+cp "$dir/Encode.asm" "$dir/new/"
+
+TIMEFORMAT=%R
+best() {
+  local t b=
+  for run in 1 2 3; do
+    t=$({ time "$1" "$2" > /dev/null; } 2>&1 | tail -1)
+    if [ -z "$b" ] || awk -v t="$t" -v b="$b" 'BEGIN { exit !(t < b) }'; then
+      b=$t
+    fi
+  done
+  echo "$b"
+}
+base=$(best "$dir/base/asm" "$dir/base/Encode.asm")
+new=$(best "$dir/new/asm" "$dir/new/Encode.asm")
+
+if ! cmp -s "$dir/base/Encode.hack" "$dir/new/Encode.hack"; then
+  echo "FAIL: the two assemblers disagree"
+  exit 1
+fi
+echo "$n C-instructions, best of 3"
+awk -v b="$base" -v t="$new" -v r="$rev" 'BEGIN {
+  printf "%-10s %6.3f s\n%-10s %6.3f s (%.1fx)\n", substr(r, 1, 10), b,
+         "this tree", t, b / t
+}'
@@ -0,0 +1,116 @@
+#!/bin/bash
+# Compares the emulator's interpreter, threaded and JIT modes on Fill.asm
+# and on two translated VM programs: recursive Fibonacci, where every
+# return is a computed jump, and a nested loop. Each mode must leave the
+# same RAM behind.
+# usage: bench_jit.sh [FILL_CYCLES]
+set -u
+cd "$(dirname "$0")"
+fill_cycles=${1:-200000000}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+g++ -std=c++17 -O2 -pthread assembler.cpp -o "$dir/assembler" || exit 1
+g++ -std=c++17 -O2 -pthread emulator.cpp -o "$dir/emulator" || exit 1
+g++ -std=c++17 -O2 -pthread ../08/VMtranslator.cpp -o "$dir/VMtranslator" ||
+  exit 1
+
+cp ../04/fill/Fill.asm "$dir/"
+"$dir/assembler" "$dir/Fill.asm" > /dev/null || exit 1
+
+mkdir "$dir/Calls"
+cat > "$dir/Calls/Main.vm" <<'VM'
+function Main.fib 0
+push argument 0
+push constant 2
+lt
+if-goto BASE
+push argument 0
+push constant 1
+sub
+call Main.fib 1
+push argument 0
+push constant 2
+sub
+call Main.fib 1
+add
+return
+label BASE
+push argument 0
+return
+function Main.sum 2
+label OUTER
+push local 0
+push argument 0
+lt
+not
+if-goto DONE
+push constant 0
+pop local 1
+label INNER
+push local 1
+push argument 0
+lt
+not
+if-goto NEXT
+push static 0
+push local 0
+push local 1
+and
+add
+pop static 0
+push local 1
+push constant 1
+add
+pop local 1
+goto INNER
+label NEXT
+push local 0
+push constant 1
+add
+pop local 0
+goto OUTER
+label DONE
+push static 0
+return
+VM
+mkdir "$dir/Loops"
+cp "$dir/Calls/Main.vm" "$dir/Loops/"
+for prog in "Calls 23 fib" "Loops 600 sum"; do
+  set -- $prog
+  cat > "$dir/$1/Sys.vm" <<VM
+function Sys.init 0
+push constant $2
+call Main.$3 1
+pop static 0
+label END
+goto END
+VM
+  "$dir/VMtranslator" --format=hack "$dir/$1" > /dev/null 2>&1 || exit 1
+done
+
+failed=0
+run() {
+  local name=$1 program=$2
+  shift 2
+  local ref=
+  for mode in "" --threaded --jit; do
+    "$dir/emulator" $mode "$@" --dump=0:4 --dump=16:31 "$program" \
+      > "$dir/ram" 2> "$dir/stat"
+    [ -z "$ref" ] && ref=$(cat "$dir/ram")
+    if [ "$(cat "$dir/ram")" != "$ref" ]; then
+      echo "FAIL $name: ${mode:-interpreter} leaves different RAM"
+      failed=1
+    fi
+    sed -n 's/.* after \([0-9]*\) cycles.*(\(.*\) M cycles\/s)/\1 \2/p' \
+      "$dir/stat" | awk -v name="$name" -v mode="${mode#--}" '{
+        printf "%-12s %-12s %11d cycles %9.1f M cycles/s\n", name,
+               mode == "" ? "interpreter" : mode, $1, $2
+      }'
+  done
+}
+run Fill "$dir/Fill.hack" --max-cycles="$fill_cycles"
+run Fill-key "$dir/Fill.hack" --max-cycles="$fill_cycles" --set=24576=1
+run Calls "$dir/Calls/Calls.hack"
+run Loops "$dir/Loops/Loops.hack"
+exit $failed
@@ -0,0 +1,55 @@
+#!/bin/bash
+# Times symbol resolution: assembles a program of N labels with this
+# tree's assembler and with the one at REV (the first commit by default),
+# and checks that both write the same .hack. The labels come 64 to an
+# address so that the program still fits in the 32K ROM, and each group
+# is followed by a reference to a label elsewhere in the program.
+# usage: bench_labels.sh [N] [REV]
+set -u
+cd "$(dirname "$0")"
+n=${1:-1000000}
+rev=${2:-$(git rev-list --max-parents=0 HEAD)}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+mkdir "$dir/base" "$dir/new" "$dir/src"
+git -C .. archive "$rev" | tar -x -C "$dir/src" || exit 1
+g++ -std=c++17 -O2 -pthread "$dir/src/06/assembler.cpp" -o "$dir/base/asm" ||
+  exit 1
+g++ -std=c++17 -O2 -pthread assembler.cpp -o "$dir/new/asm" || exit 1
+
+awk -v n="$n" 'BEGIN {
+  for (i = 0; i < n; i++) {
+    print "(L" i ")"
+    if (i % 64 == 63 || i == n - 1) {
+      print "@L" (i * 7919 + 13) % n
+      print "D;JNE"
+    }
+  }
+}' > "$dir/Labels.asm"
+cp "$dir/Labels.asm" "$dir/base/"
+cp "$dir/Labels.asm" "$dir/new/"
+
+TIMEFORMAT=%R
+best() {
+  local t b=
+  for run in 1 2 3; do
+    t=$({ time "$1" "$2" > /dev/null; } 2>&1 | tail -1)
+    if [ -z "$b" ] || awk -v t="$t" -v b="$b" 'BEGIN { exit !(t < b) }'; then
+      b=$t
+    fi
+  done
+  echo "$b"
+}
+base=$(best "$dir/base/asm" "$dir/base/Labels.asm")
+new=$(best "$dir/new/asm" "$dir/new/Labels.asm")
+
+if ! cmp -s "$dir/base/Labels.hack" "$dir/new/Labels.hack"; then
+  echo "FAIL: the two assemblers disagree"
+  exit 1
+fi
+echo "$n labels, best of 3"
+awk -v b="$base" -v t="$new" -v r="$rev" 'BEGIN {
+  printf "%-10s %6.3f s\n%-10s %6.3f s (%.1fx)\n", substr(r, 1, 10), b,
+         "this tree", t, b / t
+}'
@@ -0,0 +1,666 @@
+#include <sys/mman.h>
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+#include "../common/Hack.h"
+#include "../common/MappedFile.h"
+
+// ALU operations of the comp field; Y is A or M depending on the a-bit
+enum class Alu : uint8_t {
+  Zero, One, MinusOne, D, Y, NotD, NotY, NegD, NegY, DPlus1, YPlus1,
+  DMinus1, YMinus1, DPlusY, DMinusY, YMinusD, DAndY, DOrY, Generic
+};
+
+constexpr const char *alu_mnemonics[] = {
+    "0",   "1",   "-1",  "D",   "A",   "!D",  "!A",  "-D",  "-A",
+    "D+1", "A+1", "D-1", "A-1", "D+A", "D-A", "A-D", "D&A", "D|A"};
+
+// c-bits -> Alu, built from the assembler's comp table. Undocumented
+// c-bit patterns are still legal on the ALU and fall back to Generic.
+struct AluTable {
+  Alu op[64] = {};
+
+  constexpr AluTable() {
+    for (auto &o : op) o = Alu::Generic;
+    for (int k = 0; k < int(Alu::Generic); k++)
+      op[comp_table.find(alu_mnemonics[k]) & 0b111111] = Alu(k);
+  }
+};
+
+constexpr AluTable alu_table;
+
+// zx, nx, zy, ny, f, no as wired in 02/ALU.hdl
+int16_t alu_generic(int c, int16_t x, int16_t y) {
+  if (c & 0b100000) x = 0;
+  if (c & 0b010000) x = ~x;
+  if (c & 0b001000) y = 0;
+  if (c & 0b000100) y = ~y;
+  int16_t out = (c & 0b000010) ? int16_t(x + y) : int16_t(x & y);
+  if (c & 0b000001) out = ~out;
+  return out;
+}
+
+// A ROM word decoded once at load time
+struct Instruction {
+  enum Kind : uint8_t { Load, Compute, Halt };
+  Kind kind;
+  Alu alu;
+  bool m;        // y operand is M instead of A
+  uint8_t dest;  // A:0b100, D:0b010, M:0b001
+  uint8_t jump;  // JLT:0b100, JEQ:0b010, JGT:0b001
+  uint16_t value;  // constant of a Load, c-bits of a Compute
+};
+
+Instruction decode(uint16_t word) {
+  Instruction ins{};
+  if (!(word & 0x8000)) {
+    ins.kind = Instruction::Load;
+    ins.value = word;
+    return ins;
+  }
+  ins.kind = Instruction::Compute;
+  ins.value = word >> 6 & 0b111111;
+  ins.alu = alu_table.op[ins.value];
+  ins.m = word >> 12 & 1;
+  ins.dest = word >> 3 & 0b111;
+  ins.jump = word & 0b111;
+  return ins;
+}
+
+// Sequences emitted by Codegen::push and Codegen::pop in 08/VMtranslator.cpp
+const uint16_t push_sequence[] = {
+    0, uint16_t(encode_c("A", "M", "")), uint16_t(encode_c("M", "D", "")),
+    uint16_t(encode_c("D", "A", "")), 0, uint16_t(encode_c("M", "D+1", ""))};
+const uint16_t pop_sequence[] = {
+    0, uint16_t(encode_c("M", "M-1", "")), 0, uint16_t(encode_c("A", "M", "")),
+    uint16_t(encode_c("D", "M", ""))};
+
+// Handlers of the threaded interpreter
+enum Handler : uint8_t {
+  HLoad, HCompute, HAssign, HJump, HPush, HPop, HHalt, HEnd
+};
+
+// One entry of direct-threaded code: the handler's address and its operand
+struct Threaded {
+  const void *handler;
+  Instruction ins;
+};
+
+// Registers shared between the interpreter and compiled blocks
+struct JitState {
+  int16_t A, D;
+  int16_t *ram;
+};
+
+// Compiles straight-line runs of ROM into x86-64 code. A block starts at
+// any address control reaches and ends at the first jump, so every exit
+// is a return of the next pc to the dispatcher in Cpu::run_jit, which
+// looks the target up in the block cache. Inside a block A lives in ecx,
+// D in edx and the RAM base in rsi; only the low 16 bits are meaningful.
+struct Jit {
+  typedef uint32_t (*Code)(JitState *);
+  struct Block {
+    Code code = nullptr;
+    uint32_t length = 0;
+  };
+
+  static constexpr size_t capacity = 64 << 20;
+  static constexpr int max_length = 256;
+  uint8_t *buf = nullptr, *out = nullptr;
+  vector<Block> blocks;
+
+  Jit(size_t rom_size) : blocks(rom_size) {
+#if defined(__x86_64__)
+    void *p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED) buf = out = (uint8_t *)p;
+#endif
+  }
+
+  ~Jit() {
+    if (buf) munmap(buf, capacity);
+  }
+
+  bool ok() const { return buf != nullptr; }
+
+  void emit(initializer_list<uint8_t> bytes) {
+    for (auto b : bytes) *out++ = b;
+  }
+
+  void emit32(uint32_t v) {
+    for (int i = 0; i < 4; i++) *out++ = v >> (8 * i);
+  }
+
+  // r8d <- y operand, r9 holds the RAM index when A is not a constant
+  void load_y(const Instruction &ins, int known_a) {
+    if (!ins.m) {
+      emit({0x41, 0x89, 0xc8});  // mov r8d, ecx
+    } else if (known_a >= 0) {
+      emit({0x44, 0x0f, 0xb7, 0x86});  // movzx r8d, word [rsi+disp32]
+      emit32(2 * known_a);
+    } else {
+      emit({0x46, 0x0f, 0xb7, 0x04, 0x4e});  // movzx r8d, word [rsi+r9*2]
+    }
+  }
+
+  // eax <- ALU(D, y)
+  void alu(const Instruction &ins) {
+    switch (ins.alu) {
+      case Alu::Zero:
+        emit({0x31, 0xc0});  // xor eax, eax
+        break;
+      case Alu::One:
+        emit({0xb8, 1, 0, 0, 0});  // mov eax, 1
+        break;
+      case Alu::MinusOne:
+        emit({0xb8, 0xff, 0xff, 0, 0});  // mov eax, 0xffff
+        break;
+      case Alu::D:
+        emit({0x89, 0xd0});  // mov eax, edx
+        break;
+      case Alu::Y:
+        emit({0x44, 0x89, 0xc0});  // mov eax, r8d
+        break;
+      case Alu::NotD:
+        emit({0x89, 0xd0, 0xf7, 0xd0});  // mov eax, edx; not eax
+        break;
+      case Alu::NotY:
+        emit({0x44, 0x89, 0xc0, 0xf7, 0xd0});  // mov eax, r8d; not eax
+        break;
+      case Alu::NegD:
+        emit({0x89, 0xd0, 0xf7, 0xd8});  // mov eax, edx; neg eax
+        break;
+      case Alu::NegY:
+        emit({0x44, 0x89, 0xc0, 0xf7, 0xd8});  // mov eax, r8d; neg eax
+        break;
+      case Alu::DPlus1:
+        emit({0x8d, 0x42, 0x01});  // lea eax, [rdx+1]
+        break;
+      case Alu::YPlus1:
+        emit({0x41, 0x8d, 0x40, 0x01});  // lea eax, [r8+1]
+        break;
+      case Alu::DMinus1:
+        emit({0x8d, 0x42, 0xff});  // lea eax, [rdx-1]
+        break;
+      case Alu::YMinus1:
+        emit({0x41, 0x8d, 0x40, 0xff});  // lea eax, [r8-1]
+        break;
+      case Alu::DPlusY:
+        emit({0x42, 0x8d, 0x04, 0x02});  // lea eax, [rdx+r8]
+        break;
+      case Alu::DMinusY:
+        emit({0x89, 0xd0, 0x44, 0x29, 0xc0});  // mov eax, edx; sub eax, r8d
+        break;
+      case Alu::YMinusD:
+        emit({0x44, 0x89, 0xc0, 0x29, 0xd0});  // mov eax, r8d; sub eax, edx
+        break;
+      case Alu::DAndY:
+        emit({0x89, 0xd0, 0x44, 0x21, 0xc0});  // mov eax, edx; and eax, r8d
+        break;
+      case Alu::DOrY:
+        emit({0x89, 0xd0, 0x44, 0x09, 0xc0});  // mov eax, edx; or eax, r8d
+        break;
+      case Alu::Generic: {
+        int c = ins.value;
+        emit({0x89, 0xd0});        // mov eax, edx
+        emit({0x45, 0x89, 0xc2});  // mov r10d, r8d
+        if (c & 0b100000) emit({0x31, 0xc0});        // xor eax, eax
+        if (c & 0b010000) emit({0xf7, 0xd0});        // not eax
+        if (c & 0b001000) emit({0x45, 0x31, 0xd2});  // xor r10d, r10d
+        if (c & 0b000100) emit({0x41, 0xf7, 0xd2});  // not r10d
+        if (c & 0b000010)
+          emit({0x44, 0x01, 0xd0});  // add eax, r10d
+        else
+          emit({0x44, 0x21, 0xd0});  // and eax, r10d
+        if (c & 0b000001) emit({0xf7, 0xd0});  // not eax
+        break;
+      }
+    }
+  }
+
+  // store A and D back and return eax as the next pc
+  void leave() {
+    emit({0x66, 0x89, 0x0f});        // mov [rdi], cx
+    emit({0x66, 0x89, 0x57, 0x02});  // mov [rdi+2], dx
+    emit({0xc3});                    // ret
+  }
+
+  // nullptr once the code buffer is full
+  Block *compile(const vector<Instruction> &rom, uint32_t start) {
+    if (out + 64 * max_length > buf + capacity) return nullptr;
+    Block &block = blocks[start];
+    block.code = (Code)out;
+
+    emit({0x0f, 0xb7, 0x0f});              // movzx ecx, word [rdi]
+    emit({0x0f, 0xb7, 0x57, 0x02});        // movzx edx, word [rdi+2]
+    emit({0x48, 0x8b, 0x77, 0x08});        // mov rsi, [rdi+8]
+
+    int known_a = -1;  // value of A when it is a compile-time constant
+    uint32_t p = start;
+    while (p < rom.size() and p - start < max_length) {
+      const Instruction &ins = rom[p];
+      if (ins.kind == Instruction::Halt) break;
+      p++;
+      if (ins.kind == Instruction::Load) {
+        emit({0xb9});  // mov ecx, imm32
+        emit32(ins.value);
+        known_a = ins.value;
+        continue;
+      }
+
+      bool memory = ins.m or (ins.dest & 0b001);
+      if (memory and known_a < 0) {
+        emit({0x44, 0x0f, 0xb7, 0xc9});                    // movzx r9d, cx
+        emit({0x41, 0x81, 0xe1, 0xff, 0x7f, 0x00, 0x00});  // and r9d, 0x7fff
+      }
+      if (ins.jump) {
+        if (known_a >= 0) {
+          emit({0x41, 0xbb});  // mov r11d, imm32
+          emit32(known_a & 0x7fff);
+        } else {
+          emit({0x44, 0x0f, 0xb7, 0xd9});                    // movzx r11d, cx
+          emit({0x41, 0x81, 0xe3, 0xff, 0x7f, 0x00, 0x00});  // and r11d, 0x7fff
+        }
+      }
+      load_y(ins, known_a);
+      alu(ins);
+
+      if (ins.dest & 0b001) {
+        if (known_a >= 0) {
+          emit({0x66, 0x89, 0x86});  // mov [rsi+disp32], ax
+          emit32(2 * known_a);
+        } else {
+          emit({0x66, 0x42, 0x89, 0x04, 0x4e});  // mov [rsi+r9*2], ax
+        }
+      }
+      if (ins.dest & 0b100) {
+        emit({0x89, 0xc1});  // mov ecx, eax
+        known_a = -1;
+      }
+      if (ins.dest & 0b010) emit({0x89, 0xc2});  // mov edx, eax
+
+      if (ins.jump == 0b111) {
+        emit({0x44, 0x89, 0xd8});  // mov eax, r11d
+        leave();
+        block.length = p - start;
+        return &block;
+      }
+      if (ins.jump) {
+        // JGT, JEQ, JGE, JLT, JNE, JLE as cmovg, cmove, cmovge, ...
+        static const uint8_t cmov[] = {0, 0x4f, 0x44, 0x4d, 0x4c, 0x45, 0x4e};
+        emit({0x66, 0x85, 0xc0});  // test ax, ax
+        emit({0xb8});              // mov eax, imm32
+        emit32(p);
+        emit({0x41, 0x0f, cmov[ins.jump], 0xc3});  // cmovcc eax, r11d
+        leave();
+        block.length = p - start;
+        return &block;
+      }
+    }
+
+    emit({0xb8});  // mov eax, imm32
+    emit32(p);
+    leave();
+    block.length = p - start;
+    return &block;
+  }
+};
+
+struct Cpu {
+  int16_t A = 0, D = 0;
+  uint16_t pc = 0;
+  uint64_t cycles = 0;
+  vector<int16_t> ram = vector<int16_t>(32768);
+  vector<uint16_t> words;
+  vector<Instruction> rom;
+  vector<Threaded> code;
+  int fused = 0;
+  Jit jit;
+
+  Cpu(const vector<uint16_t> &program) : words(program), jit(program.size()) {
+    for (auto word : program) rom.emplace_back(decode(word));
+
+    // "(END) @END 0;JMP" never leaves itself, so stop there
+    for (int i = 1; i < (int)rom.size(); i++) {
+      auto &prev = rom[i - 1], &ins = rom[i];
+      if (prev.kind == Instruction::Load and prev.value == i - 1 and
+          ins.kind == Instruction::Compute and ins.dest == 0 and
+          ins.jump == 0b111)
+        ins.kind = Instruction::Halt;
+    }
+  }
+
+  static int16_t compute(Alu alu, int c, int16_t d, int16_t y) {
+    switch (alu) {
+      case Alu::Zero:
+        return 0;
+      case Alu::One:
+        return 1;
+      case Alu::MinusOne:
+        return -1;
+      case Alu::D:
+        return d;
+      case Alu::Y:
+        return y;
+      case Alu::NotD:
+        return ~d;
+      case Alu::NotY:
+        return ~y;
+      case Alu::NegD:
+        return -d;
+      case Alu::NegY:
+        return -y;
+      case Alu::DPlus1:
+        return d + 1;
+      case Alu::YPlus1:
+        return y + 1;
+      case Alu::DMinus1:
+        return d - 1;
+      case Alu::YMinus1:
+        return y - 1;
+      case Alu::DPlusY:
+        return d + y;
+      case Alu::DMinusY:
+        return d - y;
+      case Alu::YMinusD:
+        return y - d;
+      case Alu::DAndY:
+        return d & y;
+      case Alu::DOrY:
+        return d | y;
+      case Alu::Generic:
+        break;
+    }
+    return alu_generic(c, d, y);
+  }
+
+  // returns true if the program halted, false if max_cycles ran out
+  bool run(uint64_t max_cycles) {
+    int16_t a = A, d = D;
+    uint32_t p = pc;
+    uint64_t n = cycles;
+    const uint32_t size = rom.size();
+    bool halted = true;
+    while (p < size) {
+      if (n == max_cycles) {
+        halted = false;
+        break;
+      }
+      const Instruction &ins = rom[p];
+      if (ins.kind == Instruction::Load) {
+        a = ins.value;
+        p++;
+        n++;
+        continue;
+      }
+      if (ins.kind == Instruction::Halt) break;
+
+      int16_t &m = ram[a & 0x7fff];
+      int16_t out = compute(ins.alu, ins.value, d, ins.m ? m : a);
+      uint32_t target = a & 0x7fff;
+      if (ins.dest & 0b001) m = out;
+      if (ins.dest & 0b100) a = out;
+      if (ins.dest & 0b010) d = out;
+      int cond = out < 0 ? 0b100 : out == 0 ? 0b010 : 0b001;
+      p = (ins.jump & cond) ? target : p + 1;
+      n++;
+    }
+    A = a, D = d, pc = p, cycles = n;
+    return halted;
+  }
+
+  bool matches(uint32_t p, const uint16_t *sequence, int n) {
+    if (p + n > words.size()) return false;
+    for (int i = 0; i < n; i++)
+      if (words[p + i] != sequence[i]) return false;
+    return true;
+  }
+
+  // Every ROM address keeps its own entry, so jumping into the middle of
+  // a fused sequence still executes the remaining instructions one by one.
+  void translate(const void *const *handlers) {
+    code.resize(rom.size() + 1);
+    for (uint32_t p = 0; p < rom.size(); p++) {
+      auto &ins = rom[p];
+      Handler h;
+      if (matches(p, push_sequence, 6))
+        h = HPush, fused++;
+      else if (matches(p, pop_sequence, 5))
+        h = HPop, fused++;
+      else if (ins.kind == Instruction::Load)
+        h = HLoad;
+      else if (ins.kind == Instruction::Halt)
+        h = HHalt;
+      else if (ins.jump == 0)
+        h = HAssign;
+      else if (ins.jump == 0b111 and ins.dest == 0)
+        h = HJump;
+      else
+        h = HCompute;
+      code[p] = {handlers[h], ins};
+    }
+    code[rom.size()] = {handlers[HEnd], Instruction{}};
+  }
+
+  // Same semantics as run(), dispatched by computed goto with the VM
+  // translator's push/pop idioms fused into single handlers
+  bool run_threaded(uint64_t max_cycles) {
+    static const void *const handlers[] = {&&load, &&compute, &&assign, &&jump,
+                                           &&push,  &&pop,     &&halt,   &&end};
+    if (code.empty()) translate(handlers);
+
+    int16_t a = A, d = D;
+    uint32_t p = pc;
+    uint64_t n = cycles;
+    const uint32_t size = rom.size();
+    bool halted = true;
+    const Threaded *t;
+    int16_t *ram = this->ram.data();
+
+#define DISPATCH()                     \
+  do {                                 \
+    if (n >= max_cycles) goto stop;    \
+    t = &code[p < size ? p : size];    \
+    goto *t->handler;                  \
+  } while (0)
+
+    DISPATCH();
+
+  load:
+    a = t->ins.value;
+    p++, n++;
+    DISPATCH();
+
+  assign: {
+    int16_t &m = ram[a & 0x7fff];
+    int16_t out = compute(t->ins.alu, t->ins.value, d, t->ins.m ? m : a);
+    if (t->ins.dest & 0b001) m = out;
+    if (t->ins.dest & 0b100) a = out;
+    if (t->ins.dest & 0b010) d = out;
+    p++, n++;
+    DISPATCH();
+  }
+
+  jump:
+    p = a & 0x7fff, n++;
+    DISPATCH();
+
+  compute: {
+    int16_t &m = ram[a & 0x7fff];
+    int16_t out = compute(t->ins.alu, t->ins.value, d, t->ins.m ? m : a);
+    uint32_t target = a & 0x7fff;
+    if (t->ins.dest & 0b001) m = out;
+    if (t->ins.dest & 0b100) a = out;
+    if (t->ins.dest & 0b010) d = out;
+    int cond = out < 0 ? 0b100 : out == 0 ? 0b010 : 0b001;
+    p = (t->ins.jump & cond) ? target : p + 1;
+    n++;
+    DISPATCH();
+  }
+
+  // @SP / A=M / M=D / D=A / @SP / M=D+1
+  push:
+    if (max_cycles - n < 6) goto load;
+    a = ram[0];
+    ram[a & 0x7fff] = d;
+    d = a;
+    a = 0;
+    ram[0] = d + 1;
+    p += 6, n += 6;
+    DISPATCH();
+
+  // @SP / M=M-1 / @SP / A=M / D=M
+  pop:
+    if (max_cycles - n < 5) goto load;
+    ram[0]--;
+    a = ram[0];
+    d = ram[a & 0x7fff];
+    p += 5, n += 5;
+    DISPATCH();
+
+  stop:
+    halted = p >= size;
+  halt:
+  end:
+#undef DISPATCH
+    A = a, D = d, pc = p, cycles = n;
+    return halted;
+  }
+
+  // Runs compiled blocks while a whole block fits in max_cycles and lets
+  // the interpreter take over for the remainder, so the final state is
+  // the same as with run()
+  bool run_jit(uint64_t max_cycles) {
+    if (!jit.ok()) return run(max_cycles);
+    JitState state{A, D, ram.data()};
+    uint32_t p = pc;
+    const uint32_t size = rom.size();
+    bool halted = true;
+    while (p < size) {
+      if (cycles == max_cycles) {
+        halted = false;
+        break;
+      }
+      if (rom[p].kind == Instruction::Halt) break;
+      auto *block = &jit.blocks[p];
+      if (!block->code) block = jit.compile(rom, p);
+      if (!block or max_cycles - cycles < block->length) {
+        A = state.A, D = state.D, pc = p;
+        return run(max_cycles);
+      }
+      p = block->code(&state);
+      cycles += block->length;
+    }
+    A = state.A, D = state.D, pc = p;
+    return halted;
+  }
+};
+
+// .bin images are raw little-endian words, anything else is text .hack
+bool load(const string &filename, vector<uint16_t> &program) {
+  MappedFile file(filename);
+  if (!file.ok) return false;
+  string_view text = file.text();
+  if (filename.size() > 4 and filename.substr(filename.size() - 4) == ".bin") {
+    for (size_t i = 0; i + 1 < text.size(); i += 2)
+      program.emplace_back((unsigned char)text[i] |
+                           (unsigned char)text[i + 1] << 8);
+    return true;
+  }
+
+  uint16_t word = 0;
+  int bits = 0;
+  for (char c : text) {
+    if (c == '0' or c == '1') {
+      word = word << 1 | (c - '0');
+      bits++;
+    } else if (c == '\n') {
+      if (bits) program.emplace_back(word);
+      word = 0, bits = 0;
+    }
+  }
+  if (bits) program.emplace_back(word);
+  return true;
+}
+
+// all of text as a decimal number
+template <class T>
+bool number(string_view text, T &value) {
+  auto [end, ec] = from_chars(text.data(), text.data() + text.size(), value);
+  return ec == errc() and end == text.data() + text.size();
+}
+
+int main(int argc, char *args[]) {
+  string filename;
+  uint64_t max_cycles = UINT64_MAX;
+  bool threaded = false, jit = false, bad = false;
+  vector<pair<int, int>> sets, dumps;
+  for (int i = 1; i < argc; i++) {
+    string_view arg = args[i];
+    if (arg == "--threaded") {
+      threaded = true;
+    } else if (arg == "--jit") {
+      jit = true;
+    } else if (arg.substr(0, 13) == "--max-cycles=") {
+      if (!number(arg.substr(13), max_cycles)) bad = true;
+    } else if (arg.substr(0, 6) == "--set=") {
+      size_t eq = arg.find('=', 6);
+      int addr, val;
+      if (eq == string_view::npos or !number(arg.substr(6, eq - 6), addr) or
+          !number(arg.substr(eq + 1), val))
+        bad = true;
+      else
+        sets.emplace_back(addr, val);
+    } else if (arg.substr(0, 7) == "--dump=") {
+      size_t colon = arg.find(':', 7);
+      int from, to;
+      if (!number(arg.substr(7, colon - 7), from) or
+          (colon != string_view::npos and !number(arg.substr(colon + 1), to)))
+        bad = true;
+      else
+        dumps.emplace_back(from, colon == string_view::npos ? from : to);
+    } else {
+      filename = arg;
+    }
+  }
+  if (filename.empty() or bad) {
+    cout << "Usage: emulator [--threaded|--jit] [--max-cycles=N]"
+            " [--set=ADDR=VALUE]... [--dump=FROM[:TO]]... program(.hack|.bin)"
+         << endl;
+    return -1;
+  }
+
+  vector<uint16_t> program;
+  if (!load(filename, program)) {
+    cout << "Cannot open " << filename << endl;
+    return -1;
+  }
+
+  Cpu cpu(program);
+  for (auto [addr, val] : sets) cpu.ram[addr & 0x7fff] = val;
+
+  auto start = chrono::steady_clock::now();
+  bool halted = jit        ? cpu.run_jit(max_cycles)
+                : threaded ? cpu.run_threaded(max_cycles)
+                           : cpu.run(max_cycles);
+  double sec =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  for (auto [from, to] : dumps)
+    for (int i = from; i <= to; i++)
+      cout << "RAM[" << i << "] = " << cpu.ram[i & 0x7fff] << "\n";
+
+  cerr << (halted ? "halted" : "stopped") << " after " << cpu.cycles
+       << " cycles at pc " << cpu.pc << " (" << cpu.cycles / sec / 1e6
+       << " M cycles/s)" << endl;
+  if (threaded) cerr << cpu.fused << " push/pop sequences fused" << endl;
+  return 0;
+}
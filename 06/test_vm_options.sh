@@ -0,0 +1,239 @@
+#!/bin/bash
+# Runs a few VM programs through the 08 translator under each option set
+# and checks the results they store from RAM[3000] on against fixed
+# values. The programs cover every segment and arithmetic command,
+# compares feeding if-goto directly and through not, a small leaf
+# function to inline, one that is never called, and recursion.
+set -u
+cd "$(dirname "$0")"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+g++ -std=c++17 -O2 -pthread emulator.cpp -o "$dir/emulator" || exit 1
+g++ -std=c++17 -O2 -pthread ../08/VMtranslator.cpp -o "$dir/VMtranslator" ||
+  exit 1
+
+mkdir "$dir/Prog"
+cat > "$dir/Prog/Main.vm" <<'VM'
+function Main.double 0
+push argument 0
+push argument 0
+add
+return
+function Main.max 0
+push argument 0
+push argument 1
+gt
+if-goto FIRST
+push argument 1
+return
+label FIRST
+push argument 0
+return
+function Main.unused 0
+push static 5
+call Main.unused 1
+return
+function Main.ops 3
+push argument 0
+pop pointer 1
+push constant 7
+pop local 0
+push constant 12345
+pop local 1
+push local 0
+push local 1
+add
+pop that 0
+push local 0
+push local 1
+sub
+pop that 1
+push local 1
+neg
+pop that 2
+push local 1
+push constant 255
+and
+pop that 3
+push local 0
+push constant 256
+or
+pop that 4
+push local 0
+not
+pop that 5
+push local 0
+push local 1
+lt
+pop that 6
+push local 0
+push local 1
+gt
+pop that 7
+push local 0
+push constant 7
+eq
+pop that 8
+push local 0
+call Main.double 1
+pop that 9
+push local 0
+push local 1
+call Main.max 2
+pop that 10
+push constant 3100
+pop pointer 0
+push constant 42
+pop this 3
+push this 3
+pop temp 6
+push temp 6
+push constant 1
+add
+pop static 0
+push static 0
+pop that 11
+push pointer 0
+pop that 12
+push constant 0
+pop local 2
+push constant 0
+pop local 0
+label LOOP
+push local 0
+push constant 10
+lt
+not
+if-goto DONE
+push local 2
+push local 0
+call Main.double 1
+add
+pop local 2
+push local 0
+push constant 1
+add
+pop local 0
+goto LOOP
+label DONE
+push local 2
+pop that 13
+push local 2
+push constant 90
+eq
+if-goto YES
+push constant 1
+pop that 14
+goto END
+label YES
+push constant 2
+pop that 14
+label END
+push constant 0
+return
+VM
+cat > "$dir/Prog/Util.vm" <<'VM'
+function Util.fib 0
+push argument 0
+push constant 2
+lt
+if-goto BASE
+push argument 0
+push constant 1
+sub
+call Util.fib 1
+push argument 0
+push constant 2
+sub
+call Util.fib 1
+add
+return
+label BASE
+push argument 0
+return
+function Util.sum 2
+label OUTER
+push local 0
+push argument 0
+lt
+not
+if-goto DONE
+push constant 0
+pop local 1
+label INNER
+push local 1
+push argument 0
+lt
+not
+if-goto NEXT
+push static 0
+push local 0
+push local 1
+and
+add
+pop static 0
+push local 1
+push constant 1
+add
+pop local 1
+goto INNER
+label NEXT
+push local 0
+push constant 1
+add
+pop local 0
+goto OUTER
+label DONE
+push static 0
+return
+VM
+cat > "$dir/Prog/Sys.vm" <<'VM'
+function Sys.init 0
+push constant 3000
+call Main.ops 1
+pop temp 0
+push constant 3020
+pop pointer 1
+push constant 15
+call Util.fib 1
+pop that 0
+push constant 40
+call Util.sum 1
+pop that 1
+label HALT
+goto HALT
+VM
+
+expected=
+address=3000
+for value in 12352 -12338 -12345 57 263 -8 -1 0 -1 14 12345 43 3100 90 2 \
+  0 0 0 0 0 610 10992; do
+  expected+="RAM[$address] = $value"$'\n'
+  address=$((address + 1))
+done
+
+failed=0
+# --cache runs twice, so that the second run reuses every file
+for options in "" -O --tos --shared-compare --trampoline --whole-program \
+  "-O --tos" "-O --shared-compare" "-O --trampoline --tos" \
+  "--tos --shared-compare" "-O --whole-program --tos --shared-compare" \
+  "--trampoline --shared-compare --whole-program" "-O --cache" \
+  "-O --cache"; do
+  if ! "$dir/VMtranslator" $options --format=hack "$dir/Prog" 2> "$dir/err"
+  then
+    echo "FAIL '$options': $(cat "$dir/err")"
+    failed=1
+    continue
+  fi
+  got=$("$dir/emulator" --max-cycles=10000000 --dump=3000:3021 \
+    "$dir/Prog/Prog.hack" 2> /dev/null)
+  if [ "$got" != "${expected%$'\n'}" ]; then
+    echo "FAIL '$options':"
+    diff <(echo "${expected%$'\n'}") <(echo "$got")
+    failed=1
+  fi
+done
+
+[ $failed = 0 ] && echo "all tests passed"
+exit $failed
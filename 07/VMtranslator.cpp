@@ -1,251 +1,190 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <sstream>
 #include <vector>
 using namespace std;
 
-string formatLine(const string& line) {
-  int n = line.size();
-  string ret = "";
-  for (int i = 0; i < n; i++) {
-    if (i + 1 < n and line.substr(i, 2) == "//") break;
-    if (i + 1 < n and line.substr(i, 2) == "  ") continue;
-    if (line[i] == '\t') continue;
-    if (line[i] == '\r') continue;
-    ret += line[i];
-  }
-  return ret;
-}
-
-struct Statement {
-  string command, arg1, arg2;
-  Statement() : command(""), arg1(""), arg2("") {}
-  Statement(string command, string arg1, string arg2)
-      : command(command), arg1(arg1), arg2(arg2) {}
-};
-
-vector<Statement> parse(vector<string>& program) {
-  vector<Statement> ret;
-  for (string line : program) {
-    int n = line.size();
-    int phase = 0;  // 0: command, 1: arg1, 2: arg2
-    Statement s;
-    for (char c : line) {
-      if (c == ' ') {
-        phase++;
-        continue;
-      }
-
-      if (phase == 0)
-        s.command += c;
-      else if (phase == 1)
-        s.arg1 += c;
-      else
-        s.arg2 += c;
-    }
-
-    if (s.arg2.size() == 0) swap(s.arg1, s.arg2);
-    ret.emplace_back(s);
-  }
-  return ret;
-}
+#include "../common/OutputBuffer.h"
+#include "../common/VM.h"
 
 struct Codegen {
   string symbolname;
-  ofstream ofs;
+  OutputBuffer ofs;
   int label = 0;
-  Codegen(const string& outfile, vector<Statement>& statements) : ofs(outfile) {
-    int i;
-    for (i = outfile.size() - 1; i >= 0; i--)
-      if (outfile[i] == '/') {
-        i++;
-        break;
-      }
+  Codegen(const string& outfile, const vector<Statement>& statements)
+      : ofs(outfile) {
+    int i = outfile.rfind('/') + 1;  // 0 without a directory
     symbolname = outfile.substr(i, outfile.size() - i - 3);
 
-    for (auto s : statements) {
-      if (s.command == "push")
-        load(s.arg1, s.arg2), push();
-      else if (s.command == "pop")
-        pop(), store(s.arg1, s.arg2);
-      else if (s.command == "add" or s.command == "sub" or s.command == "and" or
-               s.command == "or")
-        bin_op(s.command);
-      else if (s.command == "eq" or s.command == "gt" or s.command == "lt")
-        cond_op(s.command);
-      else
-        unary_op(s.command);
+    for (const Statement& s : statements) {
+      switch (s.op) {
+        case Op::Push:
+          load(s.segment, s.index), push();
+          break;
+        case Op::Pop:
+          pop(), store(s.segment, s.index);
+          break;
+        case Op::Add:
+        case Op::Sub:
+        case Op::And:
+        case Op::Or:
+          bin_op(s.op);
+          break;
+        case Op::Eq:
+        case Op::Gt:
+        case Op::Lt:
+          cond_op(s.op);
+          break;
+        case Op::Neg:
+        case Op::Not:
+          unary_op(s.op);
+          break;
+        default:
+          cerr << "Unsupported command " << op_names[int(s.op)] << endl;
+      }
     }
   }
 
-  void unary_op(string command) {
+  void unary_op(Op op) {
     pop();
-    if (command == "neg")
-      ofs << "D=-D" << endl;
-    else if (command == "not")
-      ofs << "D=!D" << endl;
+    if (op == Op::Neg)
+      ofs << "D=-D\n";
+    else if (op == Op::Not)
+      ofs << "D=!D\n";
     push();
   }
 
-  void bin_op(string command, bool push_after = true) {
+  void bin_op(Op op, bool push_after = true) {
     // pop first arg (D <= 1st arg's value)
     pop();
 
     // dec
-    ofs << "@SP" << endl;
-    ofs << "M=M-1" << endl;
+    ofs << "@SP\n";
+    ofs << "M=M-1\n";
 
     // add
-    ofs << "@SP" << endl;
-    ofs << "A=M" << endl;
-
-    if (command == "add")
-      ofs << "D=M+D" << endl;
-    else if (command == "sub")
-      ofs << "D=M-D" << endl;
-    else if (command == "and")
-      ofs << "D=M&D" << endl;
-    else if (command == "or")
-      ofs << "D=M|D" << endl;
+    ofs << "@SP\n";
+    ofs << "A=M\n";
+
+    if (op == Op::Add)
+      ofs << "D=M+D\n";
+    else if (op == Op::Sub)
+      ofs << "D=M-D\n";
+    else if (op == Op::And)
+      ofs << "D=M&D\n";
+    else if (op == Op::Or)
+      ofs << "D=M|D\n";
 
     // push result
     if (push_after) push();
   }
 
-  void cond_op(string command) {
-    bin_op("sub", false);
+  void cond_op(Op op) {
+    bin_op(Op::Sub, false);
 
-    ofs << "@b" << label << endl;
-    if (command == "eq")
-      ofs << "D; JEQ" << endl;
-    else if (command == "gt")
-      ofs << "D; JGT" << endl;
-    else if (command == "lt")
-      ofs << "D; JLT" << endl;
+    ofs << "@b" << label << "\n";
+    if (op == Op::Eq)
+      ofs << "D; JEQ\n";
+    else if (op == Op::Gt)
+      ofs << "D; JGT\n";
+    else if (op == Op::Lt)
+      ofs << "D; JLT\n";
 
-    ofs << "@0" << endl;
-    ofs << "D=A" << endl;
+    ofs << "@0\n";
+    ofs << "D=A\n";
     push();
-    ofs << "@b" << label + 1 << endl;
-    ofs << "0; JMP" << endl;
+    ofs << "@b" << label + 1 << "\n";
+    ofs << "0; JMP\n";
 
-    ofs << "(b" << label << ")" << endl;
-    ofs << "@0" << endl;
-    ofs << "D=A" << endl;
-    ofs << "D=D-1" << endl;
+    ofs << "(b" << label << ")\n";
+    ofs << "@0\n";
+    ofs << "D=A\n";
+    ofs << "D=D-1\n";
     push();
 
-    ofs << "(b" << label + 1 << ")" << endl;
+    ofs << "(b" << label + 1 << ")\n";
 
     label += 2;
   }
 
-  void addr(string segment, string index) {
-    if (segment == "temp") {
-      ofs << "@R5" << endl;
-      ofs << "D=A" << endl;
-    } else if (segment == "pointer") {
-      ofs << "@R3" << endl;
-      ofs << "D=A" << endl;
-    } else if (segment == "static") {
-      ofs << "@" << symbolname << index << endl;
-      ofs << "D=A" << endl;
+  void addr(Segment segment, int index) {
+    if (segment == Segment::Temp) {
+      ofs << "@R5\n";
+      ofs << "D=A\n";
+    } else if (segment == Segment::Pointer) {
+      ofs << "@R3\n";
+      ofs << "D=A\n";
+    } else if (segment == Segment::Static) {
+      ofs << "@" << symbolname << index << "\n";
+      ofs << "D=A\n";
     } else {
-      if (segment == "local")
-        ofs << "@LCL" << endl;
-      else if (segment == "argument")
-        ofs << "@ARG" << endl;
-      else if (segment == "this")
-        ofs << "@THIS" << endl;
-      else if (segment == "that")
-        ofs << "@THAT" << endl;
-
-      ofs << "D=M" << endl;
+      if (segment == Segment::Local)
+        ofs << "@LCL\n";
+      else if (segment == Segment::Argument)
+        ofs << "@ARG\n";
+      else if (segment == Segment::This)
+        ofs << "@THIS\n";
+      else if (segment == Segment::That)
+        ofs << "@THAT\n";
+
+      ofs << "D=M\n";
     }
-    ofs << "@" << index << endl;
-    ofs << "A=D+A" << endl;
+    ofs << "@" << index << "\n";
+    ofs << "A=D+A\n";
   }
 
-  void load(string segment, string index) {
-    if (segment == "constant") {
-      ofs << "@" << index << endl;
-      ofs << "D=A" << endl;
+  void load(Segment segment, int index) {
+    if (segment == Segment::Constant) {
+      ofs << "@" << index << "\n";
+      ofs << "D=A\n";
     } else {
       addr(segment, index);
-      ofs << "D=M" << endl;
+      ofs << "D=M\n";
     }
   }
 
-  void store(string segment, string index) {
-    ofs << "@R13" << endl;
-    ofs << "M=D" << endl;
+  void store(Segment segment, int index) {
+    ofs << "@R13\n";
+    ofs << "M=D\n";
 
     addr(segment, index);
-    ofs << "D=A" << endl;
-    ofs << "@R14" << endl;
-    ofs << "M=D" << endl;
+    ofs << "D=A\n";
+    ofs << "@R14\n";
+    ofs << "M=D\n";
 
-    ofs << "@R13" << endl;
-    ofs << "D=M" << endl;
+    ofs << "@R13\n";
+    ofs << "D=M\n";
 
-    ofs << "@R14" << endl;
-    ofs << "A=M" << endl;
-    ofs << "M=D" << endl;
+    ofs << "@R14\n";
+    ofs << "A=M\n";
+    ofs << "M=D\n";
   }
 
   void push() {
     // store to stack
-    ofs << "@SP" << endl;
-    ofs << "A=M" << endl;
-    ofs << "M=D" << endl;
+    ofs << "@SP\n";
+    ofs << "A=M\n";
+    ofs << "M=D\n";
 
     // inc
-    ofs << "D=A" << endl;
-    ofs << "@SP" << endl;
-    ofs << "M=D+1" << endl;
+    ofs << "D=A\n";
+    ofs << "@SP\n";
+    ofs << "M=D+1\n";
   }
 
   void pop() {
     // dec
-    ofs << "@SP" << endl;
-    ofs << "M=M-1" << endl;
+    ofs << "@SP\n";
+    ofs << "M=M-1\n";
 
     // load from stack
-    ofs << "@SP" << endl;
-    ofs << "A=M" << endl;
-    ofs << "D=M" << endl;
+    ofs << "@SP\n";
+    ofs << "A=M\n";
+    ofs << "D=M\n";
   }
 };
 
-void codegen_incsp(ofstream& ofs) { ofs << "D=M" << endl; }
-
-void codegen_push(ofstream& ofs, string segment, string index) {
-  // at first, consider that only segment == "constant"
-  ofs << "@" << index << endl;
-  ofs << "D=A" << endl;
-
-  // store data to stack
-  ofs << "@SP" << endl;
-  ofs << "A=M" << endl;
-  ofs << "M=D" << endl;
-
-  // SP = SP + 1
-}
-
-void codegen_pop(ofstream& ofs, string segment, string index) {}
-
-void codegen_arith(ofstream& ofs, Statement s) {}
-
-void codegen(const string& outfile, vector<Statement>& statements) {
-  ofstream ofs(outfile);
-  for (auto s : statements) {
-    if (s.command == "push")
-      codegen_push(ofs, s.arg1, s.arg2);
-    else if (s.command == "pop")
-      codegen_pop(ofs, s.arg1, s.arg2);
-  }
-}
-
 int main(int argc, char* argv[]) {
   if (argc != 2) {
     cerr << "Arg error" << endl;
@@ -254,22 +193,15 @@ int main(int argc, char* argv[]) {
 
   string inputfile = argv[1];
   ifstream ifs(inputfile);
-  vector<string> program;
-  string line;
-  while (getline(ifs, line)) {
-    line = formatLine(line);
-    if (line == "") continue;
-    program.emplace_back(line);
-  }
+  stringstream text;
+  text << ifs.rdbuf();
 
-  auto statements = parse(program);
+  Names names;
+  vector<Statement> statements;
+  if (!parse(text.str(), names, statements, inputfile)) return -1;
 
   string outfile = inputfile.substr(0, inputfile.size() - 3) + ".asm";
   Codegen codegen(outfile, statements);
-  /*
-  for (auto s : statements)
-    cout << s.command << ":" << s.arg1 << " " << s.arg2 << endl;
-  */
 
   return 0;
 }
\ No newline at end of file
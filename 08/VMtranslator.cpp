@@ -1,406 +1,1400 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <set>
+#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
-string formatLine(const string& line) {
-  int n = line.size();
-  string ret = "";
-  for (int i = 0; i < n; i++) {
-    if (i + 1 < n and line.substr(i, 2) == "//") break;
-    if (i + 1 < n and line.substr(i, 2) == "  ") continue;
-    if (line[i] == '\t') continue;
-    if (line[i] == '\r') continue;
-    ret += line[i];
-  }
-  return ret;
-}
+#include "../common/Hack.h"
+#include "../common/OutputBuffer.h"
+#include "../common/Parallel.h"
+#include "../common/VM.h"
 
-struct Statement {
-  string command, arg1, arg2;
-  Statement() : command(""), arg1(""), arg2("") {}
-  Statement(string command, string arg1, string arg2)
-      : command(command), arg1(arg1), arg2(arg2) {}
-};
+struct Options {
+  bool optimize = false;    // -O: peephole pass over the output
+  bool trampoline = false;  // calls and returns go through shared routines
+  bool tos = false;         // the top of the VM stack is cached in D
+  bool shared_compare = false;  // eq/gt/lt call one routine per opcode
+  bool cache = false;  // reuse translated files from .vmcache/
+  // drop functions Sys.init never reaches and expand small leaf
+  // functions at their call sites; the cache is not used, as the code
+  // for a file then depends on the others
+  bool whole_program = false;
+  // with --trampoline, also translate with inline calls to compare
+  bool report = false;
 
-vector<Statement> parse(vector<string>& program) {
-  vector<Statement> ret;
-  for (string line : program) {
-    int n = line.size();
-    int phase = 0;  // 0: command, 1: arg1, 2: arg2
-    Statement s;
-    for (char c : line) {
-      if (c == ' ') {
-        phase++;
-        continue;
-      }
+  // the options that change the generated code
+  string key() const {
+    return to_string(optimize) + to_string(trampoline) + to_string(tos) +
+           to_string(shared_compare);
+  }
+};
 
-      if (phase == 0)
-        s.command += c;
-      else if (phase == 1)
-        s.arg1 += c;
-      else
-        s.arg2 += c;
-    }
+// A leaf function small enough to expand at its call sites: straight-line
+// code without statics, between the function and its only return
+struct Inline {
+  vector<Statement> body;
+  int locals = 0;
+};
 
-    if (s.arg2.size() == 0) swap(s.arg1, s.arg2);
-    ret.emplace_back(s);
-  }
-  return ret;
-}
+constexpr int prologue_limit = 8;  // locals cleared without a loop
 
+// Translates one .vm file. Labels it generates are scoped by the file
+// name and VM labels by the function, so files can be translated
+// independently and concatenated.
 struct Codegen {
   string symbolname;
-  ofstream ofs;
+  string funcname;  // function being translated
+  Names names;      // label and function names of the file
+  vector<string> code;  // one assembly line per entry
   int label = 0, ret_label = 0;
-  Codegen(const string& outfile, vector<Statement>& statements) : ofs(outfile) {
+  Options options;
+  bool cached = false;  // the stack top is in D, SP does not count it
+  set<string> compares;  // shared comparison routines to emit
+  int emitted = 0;  // instructions emitted so far, labels excluded
+  int call_body = 0, return_body = 0;  // size of the shared routines
+  int call_site = 0, return_site = 0;  // instructions at each call/return
+  const unordered_map<string, Inline>* inlines = nullptr;
+  int inlined = 0;  // call sites expanded
+  Codegen(const Options& options, const string& name = "")
+      : symbolname(name.empty() ? "" : name + "."), options(options) {}
+
+  // SP = 256, call Sys.init, then the routines shared by all files
+  void bootstrap(const set<string>& compares) {
     // initialize
-    ofs << "@256" << endl;
-    ofs << "D=A" << endl;
-    ofs << "@SP" << endl;
-    ofs << "M=D" << endl;
+    emit("@256");
+    emit("D=A");
+    emit("@SP");
+    emit("M=D");
 
     // jump to entry point
-    call("Sys.init", "0");
-    //    ofs << "@fSys.init" << endl;
-    //    ofs << "0; JMP" << endl;
-
-    for (auto s : statements) {
-      if (s.command == "symbolname") {
-        int i;
-        for (i = s.arg2.size() - 1; i >= 0; i--)
-          if (s.arg2[i] == '/') {
-            i++;
-            break;
-          }
-        symbolname = s.arg2.substr(i, s.arg2.size() - i) + ".";
-      } else if (s.command == "label")
-        ofs << "(l" << s.arg2 << ")" << endl;
-      else if (s.command == "push") {
-        load(s.arg1, s.arg2);
-        push();
-      } else if (s.command == "pop") {
-        pop();
-        store(s.arg1, s.arg2);
-      } else if (s.command == "add" or s.command == "sub" or
-                 s.command == "and" or s.command == "or")
-        bin_op(s.command);
-      else if (s.command == "eq" or s.command == "gt" or s.command == "lt")
-        cond_op(s.command);
-      else if (s.command == "not" or s.command == "neg")
-        unary_op(s.command);
-      else if (s.command == "goto") {
-        ofs << "@l" << s.arg2 << endl;
-        ofs << "0; JMP" << endl;
-      } else if (s.command == "if-goto")
-        if_goto(s.arg2);
-      else if (s.command == "call")
-        call(s.arg1, s.arg2);
-      else if (s.command == "function")
-        func(s.arg1, s.arg2);
-      else if (s.command == "return")
-        ret();
-    }
-  }
-
-  void unary_op(string command) {
+    call("Sys.init", 0);
+    if (options.trampoline) trampolines();
+
+    for (auto& command : compares) compare_routine(command);
+  }
+
+  void translate(const vector<Statement>& statements) {
+    for (size_t k = 0; k < statements.size(); k++) {
+      const Statement& s = statements[k];
+      if (options.shared_compare and is_compare(s.op)) {
+        if (k + 1 < statements.size() and
+            statements[k + 1].op == Op::IfGoto) {
+          compare_branch(s.op, false, statements[++k].symbol);
+          continue;
+        }
+        // Jack loops test "not (x < y)"
+        if (k + 2 < statements.size() and statements[k + 1].op == Op::Not and
+            statements[k + 2].op == Op::IfGoto) {
+          compare_branch(s.op, true, statements[k += 2].symbol);
+          continue;
+        }
+        if (!options.tos) {
+          compare_call(s.op);
+          continue;
+        }
+      }
+      if (options.tos and stack_top(s)) continue;
+      switch (s.op) {
+        case Op::Label:
+          emit("(" + user_label(s.symbol) + ")");
+          break;
+        case Op::Push:
+          load(s.segment, s.index);
+          push();
+          break;
+        case Op::Pop:
+          pop();
+          store(s.segment, s.index);
+          break;
+        case Op::Add:
+        case Op::Sub:
+        case Op::And:
+        case Op::Or:
+          bin_op(s.op);
+          break;
+        case Op::Eq:
+        case Op::Gt:
+        case Op::Lt:
+          cond_op(s.op);
+          break;
+        case Op::Neg:
+        case Op::Not:
+          unary_op(s.op);
+          break;
+        case Op::Goto:
+          emit("@" + user_label(s.symbol));
+          emit("0; JMP");
+          break;
+        case Op::IfGoto:
+          if_goto(s.symbol);
+          break;
+        case Op::Call:
+          if (inlines and inlines->count(names[s.symbol]))
+            inline_call(inlines->at(names[s.symbol]), s.index);
+          else
+            call(names[s.symbol], s.index);
+          break;
+        case Op::Function:
+          func(names[s.symbol], s.index);
+          break;
+        case Op::Return:
+          ret();
+          break;
+      }
+    }
+  }
+
+  void emit(const string& line) {
+    code.emplace_back(line);
+    if (line[0] != '(') emitted++;
+  }
+
+  string user_label(int symbol) {
+    return "l" + funcname + "$" + names[symbol];
+  }
+
+  string branch_label(int n) { return "b" + symbolname + to_string(n); }
+
+  string return_label() { return "r" + symbolname + to_string(ret_label); }
+
+  // Emits s keeping the stack top in D where possible and returns true.
+  // Otherwise the stack is flushed back to memory and returns false, so
+  // the regular code for s applies.
+  bool stack_top(const Statement& s) {
+    switch (s.op) {
+      case Op::Push:
+        flush();
+        load(s.segment, s.index);
+        cached = true;
+        return true;
+      case Op::Pop:
+        fill();
+        store(s.segment, s.index);
+        cached = false;
+        return true;
+      case Op::Add:
+      case Op::Sub:
+      case Op::And:
+      case Op::Or:
+        fill();
+        emit("@SP");
+        emit("AM=M-1");
+        emit(binary_comp(s.op));
+        return true;
+      case Op::Neg:
+      case Op::Not:
+        fill();
+        emit(s.op == Op::Neg ? "D=-D" : "D=!D");
+        return true;
+      case Op::Eq:
+      case Op::Gt:
+      case Op::Lt:
+        fill();
+        emit("@SP");
+        emit("AM=M-1");
+        emit("D=M-D");
+        emit("@" + branch_label(label));
+        emit("D; " + jump(s.op));
+        emit("D=0");
+        emit("@" + branch_label(label + 1));
+        emit("0; JMP");
+        emit("(" + branch_label(label) + ")");
+        emit("D=-1");
+        emit("(" + branch_label(label + 1) + ")");
+        label += 2;
+        return true;
+      case Op::IfGoto:
+        fill();
+        emit("@" + user_label(s.symbol));
+        emit("D;  JNE");
+        cached = false;
+        return true;
+      case Op::Function:
+        // nothing is cached on entry
+        cached = false;
+        return false;
+      default:
+        flush();
+        return false;
+    }
+  }
+
+  // write the cached stack top back to memory
+  void flush() {
+    if (!cached) return;
+    emit("@SP");
+    emit("M=M+1");
+    emit("A=M-1");
+    emit("M=D");
+    cached = false;
+  }
+
+  // load the stack top into D
+  void fill() {
+    if (cached) return;
+    emit("@SP");
+    emit("AM=M-1");
+    emit("D=M");
+    cached = true;
+  }
+
+  void unary_op(Op op) {
     pop();
-    if (command == "neg")
-      ofs << "D=-D" << endl;
-    else if (command == "not")
-      ofs << "D=!D" << endl;
+    emit(op == Op::Neg ? "D=-D" : "D=!D");
     push();
   }
 
-  void bin_op(string command, bool push_after = true) {
+  // D = x op D, with x addressed by A
+  static string binary_comp(Op op) {
+    if (op == Op::Add) return "D=M+D";
+    if (op == Op::Sub) return "D=M-D";
+    if (op == Op::And) return "D=M&D";
+    return "D=M|D";
+  }
+
+  void bin_op(Op op, bool push_after = true) {
     // pop first arg (D <= 1st arg's value)
     pop();
 
     // dec
-    ofs << "@SP" << endl;
-    ofs << "M=M-1" << endl;
+    emit("@SP");
+    emit("M=M-1");
 
     // add
-    ofs << "@SP" << endl;
-    ofs << "A=M" << endl;
-
-    if (command == "add")
-      ofs << "D=M+D" << endl;
-    else if (command == "sub")
-      ofs << "D=M-D" << endl;
-    else if (command == "and")
-      ofs << "D=M&D" << endl;
-    else if (command == "or")
-      ofs << "D=M|D" << endl;
+    emit("@SP");
+    emit("A=M");
+    emit(binary_comp(op));
 
     // push result
     if (push_after) push();
   }
 
-  void cond_op(string command) {
-    bin_op("sub", false);
+  static bool is_compare(Op op) {
+    return op == Op::Eq or op == Op::Gt or op == Op::Lt;
+  }
+
+  static string jump(Op op, bool negate = false) {
+    if (op == Op::Eq) return negate ? "JNE" : "JEQ";
+    if (op == Op::Gt) return negate ? "JLE" : "JGT";
+    return negate ? "JGE" : "JLT";
+  }
+
+  static string jump(const string& command) {
+    return jump(Op(lookup(op_names, command)));
+  }
+
+  // eq/gt/lt followed by if-goto, possibly through a not, branches on
+  // x - y directly
+  void compare_branch(Op op, bool negate, int target) {
+    fill();
+    emit("@SP");
+    emit("AM=M-1");
+    emit("D=M-D");
+    emit("@" + user_label(target));
+    emit("D; " + jump(op, negate));
+    cached = false;
+  }
 
-    ofs << "@b" << label << endl;
-    if (command == "eq")
-      ofs << "D; JEQ" << endl;
-    else if (command == "gt")
-      ofs << "D; JGT" << endl;
-    else if (command == "lt")
-      ofs << "D; JLT" << endl;
+  // eq/gt/lt as a call into the routine shared by the opcode; the return
+  // address is passed in R13
+  void compare_call(Op op) {
+    string command(op_names[int(op)]);
+    compares.insert(command);
+    emit("@" + branch_label(label));
+    emit("D=A");
+    emit("@R13");
+    emit("M=D");
+    emit("@$" + command);
+    emit("0; JMP");
+    emit("(" + branch_label(label) + ")");
+    label++;
+  }
+
+  // replaces x and y on the stack by x command y, then returns to R13
+  void compare_routine(const string& command) {
+    emit("($" + command + ")");
+    emit("@SP");
+    emit("AM=M-1");
+    emit("D=M");
+    emit("A=A-1");
+    emit("D=M-D");
+    emit("M=-1");
+    emit("@$" + command + ".end");
+    emit("D; " + jump(command));
+    emit("@SP");
+    emit("A=M-1");
+    emit("M=0");
+    emit("($" + command + ".end)");
+    emit("@R13");
+    emit("A=M");
+    emit("0; JMP");
+  }
 
-    ofs << "@0" << endl;
-    ofs << "D=A" << endl;
+  void cond_op(Op op) {
+    bin_op(Op::Sub, false);
+
+    emit("@" + branch_label(label));
+    emit("D; " + jump(op));
+
+    emit("@0");
+    emit("D=A");
     push();
-    ofs << "@b" << label + 1 << endl;
-    ofs << "0; JMP" << endl;
+    emit("@" + branch_label(label + 1));
+    emit("0; JMP");
 
-    ofs << "(b" << label << ")" << endl;
-    ofs << "@0" << endl;
-    ofs << "D=A" << endl;
-    ofs << "D=D-1" << endl;
+    emit("(" + branch_label(label) + ")");
+    emit("@0");
+    emit("D=A");
+    emit("D=D-1");
     push();
 
-    ofs << "(b" << label + 1 << ")" << endl;
+    emit("(" + branch_label(label + 1) + ")");
 
     label += 2;
   }
 
-  void addr(string segment, string index) {
-    if (segment == "imm") {
-      ofs << "@" << index << endl;
-      return;
-    } else if (segment == "static") {
-      ofs << "@" << symbolname << index << endl;
-      return;
-    } else if (segment == "temp") {
-      ofs << "@R5" << endl;
-      ofs << "D=A" << endl;
-    } else if (segment == "pointer") {
-      ofs << "@R3" << endl;
-      ofs << "D=A" << endl;
-    } else {
-      if (segment == "local")
-        ofs << "@LCL" << endl;
-      else if (segment == "argument")
-        ofs << "@ARG" << endl;
-      else if (segment == "this")
-        ofs << "@THIS" << endl;
-      else if (segment == "that")
-        ofs << "@THAT" << endl;
+  void addr(Segment segment, int index) {
+    switch (segment) {
+      case Segment::Static:
+        emit("@" + symbolname + to_string(index));
+        return;
+      case Segment::Stack:
+        emit("@SP");
+        emit("D=M");
+        emit("@" + to_string(index + 1));
+        emit("A=D-A");
+        return;
+      case Segment::Temp:
+        emit("@R5");
+        emit("D=A");
+        break;
+      case Segment::Pointer:
+        emit("@R3");
+        emit("D=A");
+        break;
+      default:
+        if (segment == Segment::Local)
+          emit("@LCL");
+        else if (segment == Segment::Argument)
+          emit("@ARG");
+        else if (segment == Segment::This)
+          emit("@THIS");
+        else if (segment == Segment::That)
+          emit("@THAT");
 
-      ofs << "D=M" << endl;
+        emit("D=M");
     }
-    ofs << "@" << index << endl;
-    ofs << "A=D+A" << endl;
+    emit("@" + to_string(index));
+    emit("A=D+A");
   }
 
-  void load(string segment, string index) {
-    if (segment == "constant") {
-      ofs << "@" << index << endl;
-      ofs << "D=A" << endl;
+  void load(Segment segment, int index) {
+    if (segment == Segment::Constant) {
+      emit("@" + to_string(index));
+      emit("D=A");
     } else {
       addr(segment, index);
-      ofs << "D=M" << endl;
+      emit("D=M");
     }
   }
 
-  void store(string segment, string index) {
-    ofs << "@R13" << endl;
-    ofs << "M=D" << endl;
+  // D = the word at a named address such as LCL or R15
+  void load_symbol(const string& symbol) {
+    emit("@" + symbol);
+    emit("D=M");
+  }
+
+  void store(Segment segment, int index) {
+    emit("@R13");
+    emit("M=D");
 
     addr(segment, index);
-    ofs << "D=A" << endl;
-    ofs << "@R14" << endl;
-    ofs << "M=D" << endl;
+    store_at_a();
+  }
 
-    ofs << "@R13" << endl;
-    ofs << "D=M" << endl;
+  void store_symbol(const string& symbol) {
+    emit("@R13");
+    emit("M=D");
 
-    ofs << "@R14" << endl;
-    ofs << "A=M" << endl;
-    ofs << "M=D" << endl;
+    emit("@" + symbol);
+    store_at_a();
+  }
+
+  // second half of a store: the value is in R13, the address in A
+  void store_at_a() {
+    emit("D=A");
+    emit("@R14");
+    emit("M=D");
+
+    emit("@R13");
+    emit("D=M");
+
+    emit("@R14");
+    emit("A=M");
+    emit("M=D");
   }
 
   void push() {
     // store to stack
-    ofs << "@SP" << endl;
-    ofs << "A=M" << endl;
-    ofs << "M=D" << endl;
+    emit("@SP");
+    emit("A=M");
+    emit("M=D");
 
     // inc
-    ofs << "D=A" << endl;
-    ofs << "@SP" << endl;
-    ofs << "M=D+1" << endl;
+    emit("D=A");
+    emit("@SP");
+    emit("M=D+1");
   }
 
   void pop() {
     // dec
-    ofs << "@SP" << endl;
-    ofs << "M=M-1" << endl;
+    emit("@SP");
+    emit("M=M-1");
 
     // load from stack
-    ofs << "@SP" << endl;
-    ofs << "A=M" << endl;
-    ofs << "D=M" << endl;
+    emit("@SP");
+    emit("A=M");
+    emit("D=M");
   }
 
-  void if_goto(string label) {
+  void if_goto(int symbol) {
     pop();
 
-    ofs << "@l" << label << endl;
-    ofs << "D;  JNE" << endl;
+    emit("@" + user_label(symbol));
+    emit("D;  JNE");
   }
 
-  void call(string f, string n) {
+  void call(const string& f, int n) {
+    int start = emitted;
+    if (options.trampoline) {
+      // nArgs in R13, return address in R14, target in D
+      emit("@" + to_string(n));
+      emit("D=A");
+      emit("@R13");
+      emit("M=D");
+      emit("@" + return_label());
+      emit("D=A");
+      emit("@R14");
+      emit("M=D");
+      emit("@f" + f);
+      emit("D=A");
+      emit("@$call");
+      emit("0; JMP");
+      emit("(" + return_label() + ")");
+      ret_label++;
+      call_site = emitted - start;
+      return;
+    }
+
     // push ret addr
-    ofs << "@r" << ret_label << f << endl;
-    ofs << "D=A" << endl;
+    emit("@" + return_label());
+    emit("D=A");
     push();
 
     // push LCL, ARG, THIS, THAT
-    load("imm", "LCL");
+    load_symbol("LCL");
     push();
-    load("imm", "ARG");
+    load_symbol("ARG");
     push();
-    load("imm", "THIS");
+    load_symbol("THIS");
     push();
-    load("imm", "THAT");
+    load_symbol("THAT");
     push();
 
     // reposition arg, lcl
-    load("imm", "SP");
-    ofs << "@" << 5 + stoi(n) << endl;
-    ofs << "D=D-A" << endl;
-    store("imm", "ARG");
-    load("imm", "SP");
-    store("imm", "LCL");
+    load_symbol("SP");
+    emit("@" + to_string(5 + n));
+    emit("D=D-A");
+    store_symbol("ARG");
+    load_symbol("SP");
+    store_symbol("LCL");
 
     // jump to f and label to return back
-    ofs << "@f" << f << endl;
-    ofs << "0; JMP" << endl;
-    ofs << "(r" << ret_label << f << ")" << endl;
+    emit("@f" + f);
+    emit("0; JMP");
+    emit("(" + return_label() + ")");
     ret_label++;
+    call_site = emitted - start;
   }
 
-  void func(string f, string k) {
-    ofs << "(f" << f << ")" << endl;
+  // Expands a call to f in place. The arguments, the saved THIS and THAT
+  // if f sets them, and the locals stay on the stack and are addressed
+  // relative to SP, so no frame is built. The body is rewritten to use
+  // the Stack segment, then the result replaces the arguments.
+  void inline_call(const Inline& f, int n) {
+    vector<Statement> body;
+    int depth = n;  // words above the first argument
+    auto at = [&](int slot, bool pop) {
+      // SP is taken before a push and after a pop
+      return Statement{pop ? Op::Pop : Op::Push, Segment::Stack,
+                       depth - pop - 1 - slot};
+    };
 
-    ofs << "@" << k << endl;
-    ofs << "D=A" << endl;
-    ofs << "(ils" << f << ")" << endl;  // for inner loop
-    ofs << "@ile" << f << endl;
-    ofs << "D; JEQ" << endl;
-    store("imm", "R15");
-    ofs << "D=0" << endl;
-    push();
-    load("imm", "R15");
-    ofs << "D=D-1" << endl;
-    ofs << "@ils" << f << endl;
-    ofs << "0; JMP" << endl;
-    ofs << "(ile" << f << ")" << endl;
+    vector<int> saved;  // pointer index -> slot
+    for (int p = 0; p < 2; p++) {
+      saved.push_back(-1);
+      for (auto& s : f.body)
+        if (s.op == Op::Pop and s.segment == Segment::Pointer and
+            s.index == p)
+          saved[p] = depth;
+      if (saved[p] < 0) continue;
+      body.push_back({Op::Push, Segment::Pointer, p});
+      depth++;
+    }
+    int locals = depth;
+    for (int i = 0; i < f.locals; i++, depth++)
+      body.push_back({Op::Push, Segment::Constant, 0});
+
+    for (auto& s : f.body) {
+      bool pop = s.op == Op::Pop;
+      if (s.segment == Segment::Argument)
+        body.push_back(at(s.index, pop));
+      else if (s.segment == Segment::Local)
+        body.push_back(at(locals + s.index, pop));
+      else
+        body.push_back(s);
+      if (s.op == Op::Push)
+        depth++;
+      else if (pop or (s.op != Op::Neg and s.op != Op::Not))
+        depth--;
+    }
+    for (int p = 0; p < 2; p++) {
+      if (saved[p] < 0) continue;
+      body.push_back(at(saved[p], false));
+      body.push_back({Op::Pop, Segment::Pointer, p});
+    }
+    translate(body);
+
+    // the result goes where the first argument was
+    int below = depth - 1;
+    if (below > 0) {
+      if (options.tos)
+        fill();
+      else
+        pop();
+      emit("@R13");
+      emit("M=D");
+      emit("@" + to_string(below));
+      emit("D=A");
+      emit("@SP");
+      emit("M=M-D");
+      emit("@R13");
+      emit("D=M");
+      if (!options.tos) push();
+    }
+    inlined++;
+  }
+
+  // The call and return sequences shared by every call site in
+  // trampoline mode. Both are straight-line code ending in a jump.
+  void trampolines() {
+    int start = emitted;
+    emit("($call)");
+    emit("@R15");
+    emit("M=D");
+
+    // push ret addr, LCL, ARG, THIS, THAT
+    emit("@R14");
+    emit("D=M");
+    emit("@SP");
+    emit("A=M");
+    emit("M=D");
+    for (string segment : {"LCL", "ARG", "THIS", "THAT"}) {
+      emit("@" + segment);
+      emit("D=M");
+      emit("@SP");
+      emit("AM=M+1");
+      emit("M=D");
+    }
+
+    // LCL = SP, ARG = SP - nArgs - 5
+    emit("@SP");
+    emit("MD=M+1");
+    emit("@LCL");
+    emit("M=D");
+    emit("@R13");
+    emit("D=D-M");
+    emit("@5");
+    emit("D=D-A");
+    emit("@ARG");
+    emit("M=D");
+
+    emit("@R15");
+    emit("A=M");
+    emit("0; JMP");
+    call_body = emitted - start;
+
+    start = emitted;
+    emit("($return)");
+
+    // FRAME in R15, return address in R14
+    emit("@LCL");
+    emit("D=M");
+    emit("@R15");
+    emit("M=D");
+    emit("@5");
+    emit("A=D-A");
+    emit("D=M");
+    emit("@R14");
+    emit("M=D");
+
+    // *ARG = pop(), SP = ARG + 1
+    emit("@SP");
+    emit("AM=M-1");
+    emit("D=M");
+    emit("@ARG");
+    emit("A=M");
+    emit("M=D");
+    emit("D=A+1");
+    emit("@SP");
+    emit("M=D");
+
+    // restore that, this, arg, lcl
+    for (string segment : {"THAT", "THIS", "ARG", "LCL"}) {
+      emit("@R15");
+      emit("AM=M-1");
+      emit("D=M");
+      emit("@" + segment);
+      emit("M=D");
+    }
+
+    emit("@R14");
+    emit("A=M");
+    emit("0; JMP");
+    return_body = emitted - start;
+  }
+
+  // Zeroes the k locals and moves SP past them once. Up to
+  // prologue_limit locals are cleared by straight-line code, more by a
+  // loop that keeps the count in D.
+  void func(const string& f, int k) {
+    funcname = f;
+    emit("(f" + f + ")");
+    if (k == 0) return;
+
+    if (k == 1) {
+      emit("@SP");
+      emit("AM=M+1");
+      emit("A=A-1");
+      emit("M=0");
+      return;
+    }
+
+    if (k <= prologue_limit) {
+      emit("@SP");
+      emit("A=M");
+      for (int i = 0; i < k; i++) {
+        if (i > 0) emit("A=A+1");
+        emit("M=0");
+      }
+      emit("D=A+1");
+      emit("@SP");
+      emit("M=D");
+      return;
+    }
+
+    emit("@" + to_string(k));
+    emit("D=A");
+    emit("(ils" + f + ")");  // for inner loop
+    emit("D=D-1");
+    emit("@SP");
+    emit("A=D+M");
+    emit("M=0");
+    emit("@ils" + f);
+    emit("D; JGT");
+    emit("@" + to_string(k));
+    emit("D=A");
+    emit("@SP");
+    emit("M=M+D");
   }
 
   void ret() {
+    int start = emitted;
+    if (options.trampoline) {
+      emit("@$return");
+      emit("0; JMP");
+      return_site = emitted - start;
+      return;
+    }
+
     // FRAME
-    load("imm", "LCL");
-    store("imm", "R15");
+    load_symbol("LCL");
+    store_symbol("R15");
 
     // return addr
-    load("imm", "R15");
-    ofs << "@5" << endl;
-    ofs << "A=D-A" << endl;
-    ofs << "D=M" << endl;
-    ofs << "@R14" << endl;
-    ofs << "M=D" << endl;
+    load_symbol("R15");
+    emit("@5");
+    emit("A=D-A");
+    emit("D=M");
+    emit("@R14");
+    emit("M=D");
 
     // set ret value
     pop();
-    ofs << "@ARG" << endl;
-    ofs << "A=M" << endl;
-    ofs << "M=D" << endl;
+    emit("@ARG");
+    emit("A=M");
+    emit("M=D");
 
     // restore sp, that, this, arg, lcl
-    load("imm", "ARG");
-    ofs << "D=D+1" << endl;
-    ofs << "@SP" << endl;
-    ofs << "M=D" << endl;
-
-    load("imm", "R15");
-    ofs << "A=D-1" << endl;
-    ofs << "D=M" << endl;
-    ofs << "@THAT" << endl;
-    ofs << "M=D" << endl;
-
-    load("imm", "R15");
-    ofs << "@2" << endl;
-    ofs << "A=D-A" << endl;
-    ofs << "D=M" << endl;
-    ofs << "@THIS" << endl;
-    ofs << "M=D" << endl;
-
-    load("imm", "R15");
-    ofs << "@3" << endl;
-    ofs << "A=D-A" << endl;
-    ofs << "D=M" << endl;
-    ofs << "@ARG" << endl;
-    ofs << "M=D" << endl;
-
-    load("imm", "R15");
-    ofs << "@4" << endl;
-    ofs << "A=D-A" << endl;
-    ofs << "D=M" << endl;
-    ofs << "@LCL" << endl;
-    ofs << "M=D" << endl;
+    load_symbol("ARG");
+    emit("D=D+1");
+    emit("@SP");
+    emit("M=D");
+
+    load_symbol("R15");
+    emit("A=D-1");
+    emit("D=M");
+    emit("@THAT");
+    emit("M=D");
+
+    load_symbol("R15");
+    emit("@2");
+    emit("A=D-A");
+    emit("D=M");
+    emit("@THIS");
+    emit("M=D");
+
+    load_symbol("R15");
+    emit("@3");
+    emit("A=D-A");
+    emit("D=M");
+    emit("@ARG");
+    emit("M=D");
+
+    load_symbol("R15");
+    emit("@4");
+    emit("A=D-A");
+    emit("D=M");
+    emit("@LCL");
+    emit("M=D");
 
     // jump to return
-    ofs << "@R14" << endl;
-    ofs << "A=M" << endl;
-    ofs << "0; JMP" << endl;
+    emit("@R14");
+    emit("A=M");
+    emit("0; JMP");
+    return_site = emitted - start;
   }
 };
 
-void formatFiles(string inputfile, vector<string>& program) {
-  ifstream ifs(inputfile);
-  string line;
-  while (getline(ifs, line)) {
-    line = formatLine(line);
-    if (line == "") continue;
-    program.emplace_back(line);
+// dest, comp and jump of a C-instruction, viewing the line without the
+// spaces around them; empty for labels and A-instructions
+struct Fields {
+  string_view dest, comp, jump;
+};
+
+string_view strip(string_view s) {
+  while (!s.empty() and s.front() == ' ') s.remove_prefix(1);
+  while (!s.empty() and s.back() == ' ') s.remove_suffix(1);
+  return s;
+}
+
+Fields fields(string_view line) {
+  Fields f;
+  if (line[0] == '@' or line[0] == '(') return f;
+  size_t semi = line.find(';');
+  if (semi != string_view::npos) {
+    f.jump = strip(line.substr(semi + 1));
+    line = line.substr(0, semi);
+  }
+  size_t eq = line.find('=');
+  if (eq != string_view::npos) {
+    f.dest = strip(line.substr(0, eq));
+    line = line.substr(eq + 1);
+  }
+  f.comp = strip(line);
+  return f;
+}
+
+bool has(string_view s, char c) { return s.find(c) != string_view::npos; }
+
+// Whether register r ('A' or 'D') is overwritten before it is read from
+// code[i] on, given the fields of every line. Labels and jumps end the
+// scan, as the value may be live on another path.
+bool dead(const vector<string>& code, const vector<Fields>& parsed,
+          size_t i, char r) {
+  for (; i < code.size(); i++) {
+    const string& line = code[i];
+    if (line[0] == '(') return false;
+    if (line[0] == '@') {
+      if (r == 'A') return true;
+      continue;
+    }
+    const Fields& f = parsed[i];
+    bool reads = has(f.comp, r);
+    if (r == 'A') reads = reads or has(f.comp, 'M') or has(f.dest, 'M');
+    if (reads or !f.jump.empty()) return false;
+    if (has(f.dest, r)) return true;
+  }
+  return false;
+}
+
+bool match(const vector<string>& code, size_t i,
+           initializer_list<string_view> pattern) {
+  if (i + pattern.size() > code.size()) return false;
+  for (string_view line : pattern)
+    if (code[i++] != line) return false;
+  return true;
+}
+
+// address held by a numeric or R0..R15 symbol, -1 otherwise
+int address(string_view symbol) {
+  string_view s = symbol[0] == 'R' ? symbol.substr(1) : symbol;
+  int n;
+  auto [end, ec] = from_chars(s.data(), s.data() + s.size(), n);
+  if (s.empty() or ec != errc() or end != s.data() + s.size()) return -1;
+  return symbol[0] == 'R' and n > 15 ? -1 : n;
+}
+
+int instructions(const vector<string>& code) {
+  int n = 0;
+  for (auto& line : code)
+    if (line[0] != '(') n++;
+  return n;
+}
+
+// One pass of rewrites over code, which is swapped with out. Every line
+// is split into its fields once up front. R13 and R14 are scratch
+// registers: every use writes them before reading them, and memory above
+// the stack top is never read. Returns whether anything changed.
+bool rewrite(vector<string>& code, vector<string>& out,
+             vector<Fields>& parsed) {
+  // a push immediately undone by a pop only leaves D where it was
+  const initializer_list<string_view> push_pop = {
+      "@SP", "A=M", "M=D", "D=A", "@SP", "M=D+1",
+      "@SP", "M=M-1", "@SP", "A=M", "D=M"};
+
+  bool changed = false;
+  parsed.resize(code.size());
+  for (size_t i = 0; i < code.size(); i++) parsed[i] = fields(code[i]);
+  out.clear();
+  string a;  // symbol known to be in A, empty if unknown
+  for (size_t i = 0; i < code.size(); i++) {
+    string& line = code[i];
+    if (match(code, i, push_pop) and
+        dead(code, parsed, i + push_pop.size(), 'A')) {
+      i += push_pop.size() - 1;
+      changed = true;
+      continue;
+    }
+
+    // storing through R13/R14 to a direct address: @R13 M=D @X D=A
+    // @R14 M=D @R13 D=M @R14 A=M M=D
+    if (i + 10 < code.size() and code[i + 2][0] == '@' and
+        match(code, i, {"@R13", "M=D"}) and
+        match(code, i + 3, {"D=A", "@R14", "M=D", "@R13", "D=M", "@R14",
+                            "A=M", "M=D"})) {
+      a = code[i + 2].substr(1);
+      out.emplace_back(move(code[i + 2]));
+      out.emplace_back("M=D");
+      i += 10;
+      changed = true;
+      continue;
+    }
+
+    if (line[0] == '(') {
+      a = "";
+      out.emplace_back(move(line));
+      continue;
+    }
+
+    if (line[0] == '@') {
+      string_view symbol = string_view(line).substr(1);
+      // A already holds the symbol, or is overwritten before use
+      if (symbol == a or dead(code, parsed, i + 1, 'A')) {
+        changed = true;
+        continue;
+      }
+      // @N D=A @M A=D+A becomes @N D=A @N+M; the D=A is then dead
+      int n = address(symbol);
+      if (n >= 0 and i + 3 < code.size() and code[i + 1] == "D=A" and
+          code[i + 2][0] == '@' and code[i + 3] == "A=D+A") {
+        int m = address(string_view(code[i + 2]).substr(1));
+        if (m >= 0) {
+          out.emplace_back(move(line));
+          out.emplace_back("D=A");
+          a = to_string(n + m);
+          out.emplace_back("@" + a);
+          i += 3;
+          changed = true;
+          continue;
+        }
+      }
+      a = symbol;
+      out.emplace_back(move(line));
+      continue;
+    }
+
+    const Fields& f = parsed[i];
+    if (f.jump.empty() and f.dest == "D" and
+        dead(code, parsed, i + 1, 'D')) {
+      changed = true;
+      continue;
+    }
+    if (line == "D=A" and (a == "0" or a == "1")) {
+      out.emplace_back("D=" + a);
+      changed = true;
+      continue;
+    }
+    if (line == "D=0" and i + 1 < code.size() and code[i + 1] == "D=D-1") {
+      out.emplace_back("D=-1");
+      i++;
+      changed = true;
+      continue;
+    }
+    if (has(f.dest, 'A')) a = "";
+    out.emplace_back(move(line));
+  }
+  swap(code, out);
+  return changed;
+}
+
+// Rewrites the generated code until nothing changes. No rewrite looks
+// across a label, so each block from one label to the next is brought to
+// a fixpoint on its own and only blocks that still change are rescanned.
+void peephole(vector<string>& code) {
+  vector<string> done, block, out;
+  vector<Fields> parsed;
+  done.reserve(code.size());
+  for (size_t i = 0; i < code.size();) {
+    size_t j = i + 1;
+    while (j < code.size() and code[j][0] != '(') j++;
+    block.assign(make_move_iterator(code.begin() + i),
+                 make_move_iterator(code.begin() + j));
+    bool changed = true;
+    while (changed) changed = rewrite(block, out, parsed);
+    for (auto& line : block) done.emplace_back(move(line));
+    i = j;
+  }
+  code = move(done);
+}
+
+// Changes whenever the generated code does, so that stale cache entries
+// are never reused.
+const string version = "vmtranslator 21";
+
+uint64_t fnv1a(const string& s, uint64_t h = 14695981039346656037ull) {
+  for (unsigned char c : s) h = (h ^ c) * 1099511628211ull;
+  return h;
+}
+
+string read_file(const string& path) {
+  ifstream ifs(path, ios::binary);
+  ostringstream ss;
+  ss << ifs.rdbuf();
+  return ss.str();
+}
+
+// .vmcache/<name>-<options>-<hash>.asm next to the file. The hash covers
+// the contents, the name (statics and labels use it), the options and
+// the translator version.
+string cache_entry(const string& file, const string& text,
+                   const Options& options) {
+  filesystem::path path(file);
+  string name = path.stem().string();
+  uint64_t h = fnv1a(text);
+  h = fnv1a(name + '\0' + options.key() + '\0' + version, h);
+  char hex[17];
+  snprintf(hex, sizeof hex, "%016llx", (unsigned long long)h);
+  auto dir = path.parent_path() / ".vmcache";
+  return (dir / (name + "-" + options.key() + "-" + hex + ".asm")).string();
+}
+
+// An entry is the unit's code after -O behind a two line header:
+//   // <emitted> <return_site>
+//   // <comparison routines used>...
+bool load_cached(const string& entry, Codegen& unit) {
+  ifstream ifs(entry);
+  string line, tag;
+  if (!getline(ifs, line)) return false;
+  istringstream header(line);
+  header >> tag >> unit.emitted >> unit.return_site;
+  if (!getline(ifs, line)) return false;
+  istringstream compares(line);
+  compares >> tag;
+  for (string command; compares >> command;) unit.compares.insert(command);
+  while (getline(ifs, line)) unit.code.emplace_back(line);
+  return true;
+}
+
+// replaces older entries of the same file and options
+void save_cached(const string& entry, const Codegen& unit) {
+  filesystem::path path(entry);
+  string prefix = entry.substr(0, entry.rfind('-') + 1);
+  error_code ec;
+  filesystem::create_directories(path.parent_path(), ec);
+  for (auto& old : filesystem::directory_iterator(path.parent_path(), ec)) {
+    string p = old.path().string();
+    if (p.compare(0, prefix.size(), prefix) == 0 and
+        p.find('-', prefix.size()) == string::npos)
+      filesystem::remove(old.path(), ec);
+  }
+
+  string tmp = entry + ".tmp";
+  {
+    OutputBuffer ofs(tmp);
+    ofs << "// " << unit.emitted << " " << unit.return_site << "\n";
+    ofs << "//";
+    for (auto& command : unit.compares) ofs << " " << command;
+    ofs << "\n";
+    for (auto& line : unit.code) ofs << line << "\n";
+    if (!ofs.close()) return;
+  }
+  filesystem::rename(tmp, entry, ec);
+}
+
+struct Program {
+  vector<Codegen> units;  // the bootstrap, then one per file
+  int before = 0, after = 0;  // instructions around the peephole pass
+  int call_cycles = 0, return_cycles = 0;  // instructions on each path
+  int cached = 0;  // files taken from the cache
+  int functions = 0, reachable = 0, inlined = 0;  // whole-program mode
+  bool ok = true;  // every file parsed
+};
+
+constexpr int inline_limit = 8;  // statements in an inlined body
+
+// statements [begin, end) of a file, from a function statement to the
+// next one
+struct Function {
+  int file, begin, end;
+  bool reached = false;
+};
+
+bool inlinable(const vector<Statement>& code, const Function& f,
+               Inline& inline_body) {
+  if (f.end - f.begin - 2 > inline_limit or code[f.end - 1].op != Op::Return)
+    return false;
+  int depth = 0;
+  for (int k = f.begin + 1; k < f.end - 1; k++) {
+    const Statement& s = code[k];
+    if (s.op >= Op::Label or s.segment == Segment::Static) return false;
+    int reads = 2, pushes = 1;  // a binary operator
+    if (s.op == Op::Push)
+      reads = 0;
+    else if (s.op == Op::Pop)
+      reads = 1, pushes = 0;
+    else if (s.op == Op::Neg or s.op == Op::Not)
+      reads = 1;
+    if (depth < reads) return false;
+    depth += pushes - reads;
+  }
+  if (depth < 1) return false;
+  inline_body.body.assign(code.begin() + f.begin + 1,
+                          code.begin() + f.end - 1);
+  inline_body.locals = code[f.begin].index;
+  return true;
+}
+
+// Whole-program pass. Finds the leaf functions to expand at their call
+// sites, then drops every function Sys.init does not reach through the
+// remaining calls, which includes the inlined ones. Without a Sys.init
+// nothing is dropped.
+unordered_map<string, Inline> prune(vector<vector<Statement>>& statements,
+                                    Program& program) {
+  unordered_map<string, Function> functions;
+  for (int i = 0; i < (int)statements.size(); i++) {
+    auto& code = statements[i];
+    const Names& names = program.units[i + 1].names;
+    Function* last = nullptr;
+    for (int k = 0; k < (int)code.size(); k++) {
+      if (code[k].op != Op::Function) continue;
+      if (last) last->end = k;
+      last = &functions.try_emplace(names[code[k].symbol], Function{i, k, k})
+                  .first->second;
+      if (last->file != i or last->begin != k) last = nullptr;  // redefined
+    }
+    if (last) last->end = code.size();
+  }
+
+  unordered_map<string, Inline> inlines;
+  for (auto& [name, f] : functions) {
+    Inline inline_body;
+    if (name != "Sys.init" and inlinable(statements[f.file], f, inline_body))
+      inlines[name] = inline_body;
+  }
+
+  vector<Function*> work;
+  auto reach = [&](const string& name) {
+    auto it = functions.find(name);
+    if (it == functions.end() or it->second.reached) return;
+    it->second.reached = true;
+    work.push_back(&it->second);
+  };
+  if (functions.count("Sys.init")) {
+    reach("Sys.init");
+  } else {
+    for (auto& [name, f] : functions) reach(name);
+  }
+  while (!work.empty()) {
+    Function* f = work.back();
+    work.pop_back();
+    const Names& names = program.units[f->file + 1].names;
+    for (int k = f->begin; k < f->end; k++) {
+      const Statement& s = statements[f->file][k];
+      if (s.op == Op::Call and !inlines.count(names[s.symbol]))
+        reach(names[s.symbol]);
+    }
   }
+
+  for (size_t i = 0; i < statements.size(); i++) {
+    const Names& names = program.units[i + 1].names;
+    vector<Statement> kept;
+    bool keep = true;  // code before the first function stays
+    for (auto& s : statements[i]) {
+      if (s.op == Op::Function) keep = functions[names[s.symbol]].reached;
+      if (keep) kept.push_back(s);
+    }
+    statements[i] = move(kept);
+  }
+
+  program.functions = functions.size();
+  for (auto& [name, f] : functions) program.reachable += f.reached;
+  return inlines;
+}
+
+// Translates each file on its own thread, then links the bootstrap and
+// the files in the given order, so the output does not depend on jobs.
+Program translate(const vector<string>& files, const Options& options,
+                  int jobs) {
+  Program program;
+  auto& units = program.units;
+  units.emplace_back(options);
+  for (auto& file : files)
+    units.emplace_back(options, filesystem::path(file).stem().string());
+
+  bool cache = options.cache and !options.whole_program;
+  vector<vector<Statement>> statements(files.size());
+  vector<string> entries(files.size());
+  vector<char> reused(files.size()), parsed(files.size(), 1);
+  parallel(files.size(), jobs, [&](int i) {
+    auto& unit = units[i + 1];
+    string text = read_file(files[i]);
+    if (cache) {
+      entries[i] = cache_entry(files[i], text, options);
+      if ((reused[i] = load_cached(entries[i], unit))) return;
+    }
+    parsed[i] = parse(text, unit.names, statements[i], files[i]);
+  });
+  if (count(parsed.begin(), parsed.end(), 0)) {
+    program.ok = false;
+    return program;
+  }
+
+  unordered_map<string, Inline> inlines;
+  if (options.whole_program) {
+    inlines = prune(statements, program);
+    for (auto& unit : units) unit.inlines = &inlines;
+  }
+  parallel(files.size(), jobs, [&](int i) {
+    if (reused[i]) return;
+    auto& unit = units[i + 1];
+    unit.translate(statements[i]);
+    if (options.optimize) peephole(unit.code);
+    if (cache) save_cached(entries[i], unit);
+  });
+  program.cached = count(reused.begin(), reused.end(), 1);
+
+  set<string> compares;
+  for (auto& unit : units)
+    compares.insert(unit.compares.begin(), unit.compares.end());
+  units[0].bootstrap(compares);
+  if (options.optimize) peephole(units[0].code);
+
+  int return_site = 0;
+  for (auto& unit : units) {
+    program.before += unit.emitted;
+    program.inlined += unit.inlined;
+    program.after += instructions(unit.code);
+    return_site = max(return_site, unit.return_site);
+  }
+  program.call_cycles = units[0].call_site + units[0].call_body;
+  program.return_cycles = return_site + units[0].return_body;
+  return program;
+}
+
+// Assembles the linked code in memory, as 06/assembler would from the
+// .asm file: labels are bound first, then every other symbol becomes a
+// variable from RAM[16] on in order of first reference.
+bool assemble(const vector<Codegen>& units, vector<uint16_t>& words) {
+  unordered_map<string_view, int> symbols;
+  for (auto& p : predefined) symbols[p.name] = p.address;
+  int pc = 0;
+  for (auto& unit : units)
+    for (auto& line : unit.code) {
+      if (line[0] == '(')
+        symbols[string_view(line).substr(1, line.size() - 2)] = pc;
+      else
+        pc++;
+    }
+
+  int next = 16;
+  words.reserve(pc);
+  for (auto& unit : units)
+    for (auto& line : unit.code) {
+      if (line[0] == '(') continue;
+      if (line[0] == '@') {
+        string_view symbol = string_view(line).substr(1);
+        const char* end = symbol.data() + symbol.size();
+        int value;
+        auto [p, ec] = from_chars(symbol.data(), end, value);
+        if (ec != errc() or p != end) {
+          auto [it, added] = symbols.try_emplace(symbol, next);
+          if (added) next++;
+          value = it->second;
+        }
+        words.push_back(value);
+      } else {
+        // encode_c skips the spaces the code generator puts around ';'
+        string_view comp = line, dest, jump;
+        size_t semi = comp.find(';'), eq = comp.find('=');
+        if (semi != string_view::npos) {
+          jump = comp.substr(semi + 1);
+          comp = comp.substr(0, semi);
+        }
+        if (eq != string_view::npos) {
+          dest = comp.substr(0, eq);
+          comp = comp.substr(eq + 1);
+        }
+        int word = encode_c(dest, comp, jump);
+        if (word < 0) {
+          cerr << "Invalid instruction: " << line << endl;
+          return false;
+        }
+        words.push_back(word);
+      }
+    }
+  return true;
+}
+
+// 16 '0'/'1' characters per line, or the raw little-endian words
+bool write_hack(const string& outfile, const vector<uint16_t>& words,
+                bool binary) {
+  OutputBuffer ofs(outfile);
+  for (uint16_t word : words) {
+    char buf[17];
+    if (binary) {
+      buf[0] = word & 0xff;
+      buf[1] = word >> 8;
+      ofs << string_view(buf, 2);
+      continue;
+    }
+    for (int i = 0; i < 16; i++) buf[i] = '0' + (word >> (15 - i) & 1);
+    buf[16] = '\n';
+    ofs << string_view(buf, 17);
+  }
+  return ofs.close();
 }
 
 int main(int argc, char* argv[]) {
-  if (argc != 2) {
+  string inputfile, format = "asm";
+  Options options;
+  int jobs = 1;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-O")
+      options.optimize = true;
+    else if (arg == "--trampoline")
+      options.trampoline = true;
+    else if (arg == "--tos")
+      options.tos = true;
+    else if (arg == "--shared-compare")
+      options.shared_compare = true;
+    else if (arg == "--cache")
+      options.cache = true;
+    else if (arg == "--whole-program")
+      options.whole_program = true;
+    else if (arg == "--report")
+      options.report = true;
+    else if (arg.substr(0, 7) == "--jobs=")
+      jobs = max(1, atoi(arg.c_str() + 7));
+    else if (arg.substr(0, 9) == "--format=")
+      format = arg.substr(9);
+    else
+      inputfile = arg;
+  }
+  if (inputfile.empty() or
+      (format != "asm" and format != "hack" and format != "bin")) {
     cerr << "Arg error" << endl;
     return -1;
   }
 
-  string inputfile = argv[1];
-  vector<string> programs;
+  vector<string> files;
   string outfile;
-  if (inputfile.substr(inputfile.size() - 3, 3) == ".vm") {
-    outfile = inputfile.substr(0, inputfile.size() - 3) + ".asm";
-    formatFiles(inputfile, programs);
+  auto is_vm = [](const string& p) {
+    return p.size() > 3 and p.substr(p.size() - 3) == ".vm";
+  };
+  if (is_vm(inputfile)) {
+    outfile = inputfile.substr(0, inputfile.size() - 3) + "." + format;
+    files.emplace_back(inputfile);
   } else {
-    if (inputfile[inputfile.size() - 1] == '/')
-      inputfile = inputfile.substr(0, inputfile.size() - 1);
+    if (!filesystem::is_directory(inputfile)) {
+      cerr << "Cannot open " << inputfile << endl;
+      return -1;
+    }
+    // dir and dir/ both write dir/dir.asm
+    string name = filesystem::canonical(inputfile).filename().string();
+    outfile = (filesystem::path(inputfile) / (name + "." + format)).string();
+    for (const auto& entry : filesystem::directory_iterator(inputfile)) {
+      string p = entry.path();
+      if (is_vm(p)) files.emplace_back(p);
+    }
+    sort(files.begin(), files.end());
+  }
 
-    int i;
-    for (i = inputfile.size() - 1; i >= 0; i--)
-      if (inputfile[i] == '/') break;
-    outfile = inputfile + inputfile.substr(i, inputfile.size() - i) + ".asm";
+  Program program = translate(files, options, jobs);
+  if (!program.ok) return -1;
+  if (options.cache)
+    cerr << "cache: " << program.cached << " of " << files.size()
+         << " files reused" << endl;
+  if (options.whole_program)
+    cerr << "whole program: " << program.reachable << " of "
+         << program.functions << " functions reachable, " << program.inlined
+         << " calls inlined" << endl;
+  if (options.optimize)
+    cerr << "peephole: " << program.before << " -> " << program.after
+         << " instructions (" << program.before - program.after << " saved)"
+         << endl;
 
-    for (const auto& entry : std::filesystem::directory_iterator(inputfile)) {
-      string p = entry.path();
-      programs.emplace_back("symbolname " + p.substr(0, p.size() - 3));
-      if (p.substr(p.size() - 3, 3) == ".vm") formatFiles(p, programs);
+  if (options.trampoline and !options.report)
+    cerr << "trampoline: " << program.after << " instructions, "
+         << program.call_cycles << " cycles per call, "
+         << program.return_cycles << " per return" << endl;
+  if (options.trampoline and options.report) {
+    Options inline_options = options;
+    inline_options.trampoline = false;
+    inline_options.cache = false;
+    Program inline_calls = translate(files, inline_options, jobs);
+    cerr << "trampoline: " << program.after << " instructions (inline "
+         << inline_calls.after << "), " << program.call_cycles
+         << " cycles per call (inline " << inline_calls.call_cycles << "), "
+         << program.return_cycles << " per return (inline "
+         << inline_calls.return_cycles << ")" << endl;
+  }
+
+  if (format != "asm") {
+    vector<uint16_t> words;
+    if (!assemble(program.units, words)) return -1;
+    if (!write_hack(outfile, words, format == "bin")) {
+      cerr << "Cannot write " << outfile << endl;
+      return -1;
     }
+    return 0;
   }
 
-  auto statements = parse(programs);
-  Codegen codegen(outfile, statements);
+  OutputBuffer ofs(outfile);
+  for (auto& unit : program.units)
+    for (auto& line : unit.code) ofs << line << "\n";
+  if (!ofs.close()) {
+    cerr << "Cannot write " << outfile << endl;
+    return -1;
+  }
 
   return 0;
 }
\ No newline at end of file
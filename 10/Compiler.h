@@ -0,0 +1,628 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+using namespace std;
+
+#include "../common/VM.h"
+#include "Parser.h"
+
+// A variable lives in the VM segment of its kind: static, this for
+// fields, argument, or local for vars.
+struct Variable {
+  string_view type;
+  Segment segment;
+  int index;
+};
+
+// Class scope for statics and fields, subroutine scope for arguments and
+// locals; names view the source, so lookups do not copy them.
+struct SymbolTable {
+  unordered_map<string_view, Variable> class_scope, subroutine_scope;
+  int count[size(segment_names)] = {};
+
+  void define(string_view name, string_view type, Segment segment) {
+    bool in_class = segment == Segment::Static or segment == Segment::This;
+    auto& scope = in_class ? class_scope : subroutine_scope;
+    scope[name] = {type, segment, count[int(segment)]++};
+  }
+
+  void start_subroutine() {
+    subroutine_scope.clear();
+    count[int(Segment::Argument)] = count[int(Segment::Local)] = 0;
+  }
+
+  // nullptr if name is not a variable
+  const Variable* find(string_view name) const {
+    auto it = subroutine_scope.find(name);
+    if (it != subroutine_scope.end()) return &it->second;
+    it = class_scope.find(name);
+    return it == class_scope.end() ? nullptr : &it->second;
+  }
+};
+
+// Walks the parse tree of one class and writes its VM code to code,
+// reusing its storage. Errors are reported to err with the position of
+// the offending token and clear ok; compilation carries on so that they
+// are all reported.
+struct Compiler {
+  const Tree& tree;
+  string filename;
+  string& code;
+  ostream& err;
+  SymbolTable symbols;
+  string_view class_name;
+  int labels = 0;  // per subroutine, as VM labels are scoped by function
+  int shifts = 0;  // bit k is set when the class divides by 2^k
+  bool ok = true;
+
+  Compiler(const Tree& tree, const string& filename, string& code,
+           ostream& err = cerr)
+      : tree(tree), filename(filename), code(code), err(err) {
+    code.clear();
+    code.reserve(tree.tokens.size() * 8);
+  }
+
+  NodeKind kind(int id) const { return tree[id].kind; }
+  int count(int id) const { return tree[id].count; }
+  int child(int id, int i) const { return tree.child(id, i); }
+
+  // the word of the i-th child, which must be a terminal
+  string_view word(int id, int i) const {
+    int c = child(id, i);
+    return kind(c) == NodeKind::Terminal ? tree.token(c).word : "";
+  }
+
+  // whether the term id starts with the symbol s
+  bool symbol(int id, string_view s) const {
+    const Token& t = tree.token(child(id, 0));
+    return t.kind == TokenKind::Symbol and t.word == s;
+  }
+
+  void fail(int id, const string& msg) {
+    while (kind(id) != NodeKind::Terminal and count(id) > 0)
+      id = child(id, 0);
+    if (kind(id) == NodeKind::Terminal) {
+      const Token& t = tree.token(id);
+      err << filename << ":" << t.line << ":" << t.column << ": " << msg
+          << endl;
+    } else {
+      err << filename << ": " << msg << endl;
+    }
+    ok = false;
+  }
+
+  void emit(string_view command) {
+    code += command;
+    code += '\n';
+  }
+
+  void emit(string_view command, string_view arg) {
+    code += command;
+    code += ' ';
+    code += arg;
+    code += '\n';
+  }
+
+  void emit(string_view command, string_view arg, int n) {
+    code += command;
+    code += ' ';
+    code += arg;
+    code += ' ';
+    code += to_string(n);
+    code += '\n';
+  }
+
+  void push(Segment segment, int index) {
+    emit("push", segment_names[int(segment)], index);
+  }
+
+  void pop(Segment segment, int index) {
+    emit("pop", segment_names[int(segment)], index);
+  }
+
+  // any 16-bit value, although Jack constants only go up to 32767
+  void push_constant(int16_t value) {
+    if (value == INT16_MIN) {
+      push(Segment::Constant, INT16_MAX);
+      emit("not");
+    } else {
+      push(Segment::Constant, abs(value));
+      if (value < 0) emit("neg");
+    }
+  }
+
+  string label(string_view name, int n) {
+    return string(name) + to_string(n);
+  }
+
+  // 'class' className '{' classVarDec* subroutineDec* '}'
+  void compile_class(int id) {
+    class_name = word(id, 1);
+    for (int i = 3; i < count(id); i++) {
+      int c = child(id, i);
+      if (kind(c) == NodeKind::ClassVarDec)
+        compile_class_var_dec(c);
+      else if (kind(c) == NodeKind::SubroutineDec)
+        compile_subroutine(c);
+    }
+    for (int k = 1; k < 15; k++)
+      if (shifts >> k & 1) compile_shift(k);
+  }
+
+  // ('static' | 'field') type varName (',' varName)* ';'
+  void compile_class_var_dec(int id) {
+    Segment segment =
+        word(id, 0) == "static" ? Segment::Static : Segment::This;
+    for (int i = 2; i < count(id); i += 2)
+      symbols.define(word(id, i), word(id, 1), segment);
+  }
+
+  // ('constructor' | 'function' | 'method') type subroutineName
+  // '(' parameterList ')' subroutineBody
+  void compile_subroutine(int id) {
+    string_view kind_word = word(id, 0);
+    symbols.start_subroutine();
+    labels = 0;
+    if (kind_word == "method")
+      symbols.define("this", class_name, Segment::Argument);
+
+    int parameters = child(id, 4);
+    for (int i = 0; i + 1 < count(parameters); i += 3)
+      symbols.define(word(parameters, i + 1), word(parameters, i),
+                     Segment::Argument);
+
+    int body = child(id, 6);
+    int statements = -1;
+    for (int i = 1; i < count(body); i++) {
+      int c = child(body, i);
+      if (kind(c) == NodeKind::VarDec) {
+        for (int k = 2; k < count(c); k += 2)
+          symbols.define(word(c, k), word(c, 1), Segment::Local);
+      } else if (kind(c) == NodeKind::Statements) {
+        statements = c;
+      }
+    }
+
+    string name = string(class_name) + "." + string(word(id, 2));
+    emit("function", name, symbols.count[int(Segment::Local)]);
+    if (kind_word == "constructor") {
+      push(Segment::Constant, symbols.count[int(Segment::This)]);
+      emit("call", "Memory.alloc", 1);
+      pop(Segment::Pointer, 0);
+    } else if (kind_word == "method") {
+      push(Segment::Argument, 0);
+      pop(Segment::Pointer, 0);
+    }
+    if (statements >= 0) compile_statements(statements);
+  }
+
+  void compile_statements(int id) {
+    for (int i = 0; i < count(id); i++) {
+      int c = child(id, i);
+      switch (kind(c)) {
+        case NodeKind::LetStatement:
+          compile_let(c);
+          break;
+        case NodeKind::IfStatement:
+          compile_if(c);
+          break;
+        case NodeKind::WhileStatement:
+          compile_while(c);
+          break;
+        case NodeKind::DoStatement:
+          compile_call(c, 1);
+          pop(Segment::Temp, 0);
+          break;
+        case NodeKind::ReturnStatement:
+          if (count(c) == 3)
+            compile_expression(child(c, 1));
+          else
+            push(Segment::Constant, 0);
+          emit("return");
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  const Variable* variable(int id, int i) {
+    const Variable* v = symbols.find(word(id, i));
+    if (!v) fail(child(id, i), "undefined variable " + string(word(id, i)));
+    return v;
+  }
+
+  // 'let' varName ('[' expression ']')? '=' expression ';'
+  void compile_let(int id) {
+    const Variable* v = variable(id, 1);
+    if (!v) return;
+    if (word(id, 2) == "[") {
+      push(v->segment, v->index);
+      compile_expression(child(id, 3));
+      emit("add");
+      compile_expression(child(id, 6));
+      pop(Segment::Temp, 0);
+      pop(Segment::Pointer, 1);
+      push(Segment::Temp, 0);
+      pop(Segment::That, 0);
+    } else {
+      compile_expression(child(id, 3));
+      pop(v->segment, v->index);
+    }
+  }
+
+  // 'if' '(' expression ')' '{' statements '}'
+  // ('else' '{' statements '}')?
+  void compile_if(int id) {
+    int n = labels++;
+    compile_expression(child(id, 2));
+    emit("if-goto", label("IF_TRUE", n));
+    emit("goto", label("IF_FALSE", n));
+    emit("label", label("IF_TRUE", n));
+    compile_statements(child(id, 5));
+    if (count(id) > 7) {
+      emit("goto", label("IF_END", n));
+      emit("label", label("IF_FALSE", n));
+      compile_statements(child(id, 9));
+      emit("label", label("IF_END", n));
+    } else {
+      emit("label", label("IF_FALSE", n));
+    }
+  }
+
+  // 'while' '(' expression ')' '{' statements '}'
+  void compile_while(int id) {
+    int n = labels++;
+    emit("label", label("WHILE_EXP", n));
+    compile_expression(child(id, 2));
+    emit("not");
+    emit("if-goto", label("WHILE_END", n));
+    compile_statements(child(id, 5));
+    emit("goto", label("WHILE_EXP", n));
+    emit("label", label("WHILE_END", n));
+  }
+
+  // a op b as the generated code computes it, wrapping to 16 bits. The
+  // VM's lt and gt test the sign of the wrapped difference a - b, so
+  // 20000 < -20000 is true here as well. Division by zero is not folded,
+  // so that Math.divide reports it.
+  static bool fold(string_view op, int16_t& a, int16_t b) {
+    int r;
+    if (op == "+")
+      r = a + b;
+    else if (op == "-")
+      r = a - b;
+    else if (op == "*")
+      r = a * b;
+    else if (op == "/" and b != 0)
+      r = a / b;
+    else if (op == "&")
+      r = a & b;
+    else if (op == "|")
+      r = a | b;
+    else if (op == "<")
+      r = int16_t(a - b) < 0 ? -1 : 0;
+    else if (op == ">")
+      r = int16_t(a - b) > 0 ? -1 : 0;
+    else if (op == "=")
+      r = a == b ? -1 : 0;
+    else
+      return false;
+    a = int16_t(r);
+    return true;
+  }
+
+  // whether the expression or term id is made of constants only, and
+  // its value if so
+  bool constant(int id, int16_t& value) {
+    if (kind(id) == NodeKind::Expression) {
+      if (!constant(child(id, 0), value)) return false;
+      int16_t rhs;
+      for (int i = 1; i + 1 < count(id); i += 2)
+        if (!constant(child(id, i + 1), rhs) or !fold(word(id, i), value, rhs))
+          return false;
+      return true;
+    }
+
+    const Token& t = tree.token(child(id, 0));
+    switch (t.kind) {
+      case TokenKind::IntegerConstant: {
+        int v = INT16_MAX + 1;
+        if (t.word.size() <= 5)
+          from_chars(t.word.data(), t.word.data() + t.word.size(), v);
+        value = v;
+        return v <= INT16_MAX;  // else left for compile_term to report
+      }
+      case TokenKind::Keyword:
+        value = t.word == "true" ? -1 : 0;
+        return t.word != "this";
+      case TokenKind::Symbol:
+        if (!constant(child(id, 1), value)) return false;
+        if (t.word == "-") value = -value;
+        if (t.word == "~") value = ~value;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  void emit_op(string_view op) {
+    if (op == "+")
+      emit("add");
+    else if (op == "-")
+      emit("sub");
+    else if (op == "*")
+      emit("call", "Math.multiply", 2);
+    else if (op == "/")
+      emit("call", "Math.divide", 2);
+    else if (op == "&")
+      emit("and");
+    else if (op == "|")
+      emit("or");
+    else if (op == "<")
+      emit("lt");
+    else if (op == ">")
+      emit("gt");
+    else
+      emit("eq");
+  }
+
+  // Multiplies the top of the stack by c. Math.multiply loops over all
+  // 16 bits, so a c with few bits set is cheaper as a chain of doublings
+  // kept in temp 0 and added up on the stack.
+  void multiply_by(int16_t c) {
+    if (c == 0) {
+      pop(Segment::Temp, 0);
+      push(Segment::Constant, 0);
+      return;
+    }
+    int m = abs(int(c)), bits = 0;
+    for (int k = m; k; k &= k - 1) bits++;
+    if (bits > 3) {
+      push_constant(c);
+      emit("call", "Math.multiply", 2);
+      return;
+    }
+    if (bits == 1) {
+      for (; m > 1; m >>= 1) {
+        pop(Segment::Temp, 0);
+        push(Segment::Temp, 0);
+        push(Segment::Temp, 0);
+        emit("add");
+      }
+    } else {
+      pop(Segment::Temp, 0);
+      for (bool first = true; m; m >>= 1) {
+        if (m & 1) {
+          push(Segment::Temp, 0);
+          if (!first) emit("add");
+          first = false;
+        }
+        if (m > 1) {
+          push(Segment::Temp, 0);
+          push(Segment::Temp, 0);
+          emit("add");
+          pop(Segment::Temp, 0);
+        }
+      }
+    }
+    if (c < 0) emit("neg");
+  }
+
+  // the function compile_shift(k) writes; Jack names cannot hold a '$'
+  string shift_name(int k) {
+    return string(class_name) + ".$div" + to_string(1 << k);
+  }
+
+  // Class.$div<2^k>(x) is x / 2^k rounded towards zero, as an arithmetic
+  // shift: a negative x is first biased by 2^k - 1, then each bit from k
+  // up is tested and added in at its shifted weight, the sign bit with a
+  // negative one. It is written once per class, after the subroutines.
+  void compile_shift(int k) {
+    emit("function", shift_name(k), 0);
+    push(Segment::Argument, 0);
+    push(Segment::Argument, 0);
+    push(Segment::Constant, 0);
+    emit("lt");
+    push(Segment::Constant, (1 << k) - 1);
+    emit("and");
+    emit("add");
+    pop(Segment::Argument, 0);
+    push(Segment::Constant, 0);
+    for (int bit = k; bit < 15; bit++) {
+      push(Segment::Argument, 0);
+      push(Segment::Constant, 1 << bit);
+      emit("and");
+      push(Segment::Constant, 0);
+      emit("gt");
+      push(Segment::Constant, 1 << (bit - k));
+      emit("and");
+      emit("add");
+    }
+    push(Segment::Argument, 0);
+    push(Segment::Constant, 0);
+    emit("lt");
+    push(Segment::Constant, 1 << (15 - k));
+    emit("and");
+    emit("sub");
+    emit("return");
+  }
+
+  // Divides the top of the stack by c, rounding towards zero like
+  // Math.divide. Dividing by 2^k calls the class's shift for k.
+  void divide_by(int16_t c) {
+    int m = abs(int(c)), k = 0;
+    if (c == INT16_MIN or (m & (m - 1)) != 0) {
+      push_constant(c);
+      emit("call", "Math.divide", 2);
+      return;
+    }
+    while (1 << k < m) k++;
+    if (k > 0) {
+      emit("call", shift_name(k), 1);
+      shifts |= 1 << k;
+    }
+    if (c < 0) emit("neg");
+  }
+
+  // op with the constant c as its right operand, the left one on the
+  // stack
+  void compile_op(string_view op, int16_t c) {
+    bool identity = ((op == "+" or op == "-" or op == "|") and c == 0) or
+                    (op == "&" and c == -1);
+    if (identity) return;
+    if (op == "*") {
+      multiply_by(c);
+    } else if (op == "/" and c != 0) {
+      divide_by(c);
+    } else {
+      push_constant(c);
+      emit_op(op);
+    }
+  }
+
+  // term (op term)*, evaluated left to right. A run of constants at the
+  // start is folded into one, and constant right operands go through
+  // compile_op, which drops identities and avoids Math calls.
+  void compile_expression(int id) {
+    int16_t value, rhs;
+    int i = 1;
+    if (constant(child(id, 0), value)) {
+      for (; i + 1 < count(id); i += 2) {
+        int16_t folded = value;
+        if (!constant(child(id, i + 1), rhs) or
+            !fold(word(id, i), folded, rhs))
+          break;
+        value = folded;
+      }
+      if (i + 1 >= count(id)) {
+        push_constant(value);
+        return;
+      }
+      // c * x and 0 + x or 0 | x with x not constant: only x is pushed
+      string_view op = word(id, i);
+      bool identity = (op == "+" or op == "|") and value == 0;
+      if (op == "*" or identity) {
+        compile_term(child(id, i + 1));
+        if (op == "*") multiply_by(value);
+        i += 2;
+      } else {
+        push_constant(value);
+      }
+    } else {
+      compile_term(child(id, 0));
+    }
+
+    for (; i + 1 < count(id); i += 2) {
+      string_view op = word(id, i);
+      if (constant(child(id, i + 1), rhs)) {
+        compile_op(op, rhs);
+      } else {
+        compile_term(child(id, i + 1));
+        emit_op(op);
+      }
+    }
+  }
+
+  void compile_term(int id) {
+    const Token& t = tree.token(child(id, 0));
+    string_view next = count(id) > 1 ? word(id, 1) : "";
+    switch (t.kind) {
+      case TokenKind::IntegerConstant: {
+        int value = 0;
+        from_chars(t.word.data(), t.word.data() + t.word.size(), value);
+        if (t.word.size() > 5 or value > 32767)
+          fail(child(id, 0), "integer constant out of range");
+        push(Segment::Constant, value);
+        return;
+      }
+      case TokenKind::StringConstant:
+        push(Segment::Constant, t.word.size());
+        emit("call", "String.new", 1);
+        for (unsigned char c : t.word) {
+          push(Segment::Constant, c);
+          emit("call", "String.appendChar", 2);
+        }
+        return;
+      case TokenKind::Keyword:
+        if (t.word == "this") {
+          push(Segment::Pointer, 0);
+        } else {
+          push(Segment::Constant, 0);
+          if (t.word == "true") emit("not");
+        }
+        return;
+      case TokenKind::Symbol: {
+        if (t.word == "(") {
+          compile_expression(child(id, 1));
+          return;
+        }
+        int16_t value;
+        if (constant(id, value)) {
+          push_constant(value);
+          return;
+        }
+        // -(-x) and ~(~x) are x
+        int inner = child(id, 1);
+        while (symbol(inner, "(") and count(child(inner, 1)) == 1)
+          inner = child(child(inner, 1), 0);
+        if (symbol(inner, t.word)) {
+          compile_term(child(inner, 1));
+          return;
+        }
+        compile_term(inner);
+        emit(t.word == "-" ? "neg" : "not");
+        return;
+      }
+      case TokenKind::Identifier:
+        break;
+    }
+
+    if (next == "(" or next == ".") {
+      compile_call(id, 0);
+      return;
+    }
+    const Variable* v = variable(id, 0);
+    if (!v) return;
+    push(v->segment, v->index);
+    if (next == "[") {
+      compile_expression(child(id, 2));
+      emit("add");
+      pop(Segment::Pointer, 1);
+      push(Segment::That, 0);
+    }
+  }
+
+  // subroutineName '(' expressionList ')' or
+  // (className | varName) '.' subroutineName '(' expressionList ')',
+  // starting at the i-th child of id
+  void compile_call(int id, int i) {
+    string name;
+    int args = 0;
+    if (word(id, i + 1) == ".") {
+      string_view target = word(id, i);
+      const Variable* v = symbols.find(target);
+      if (v) {
+        push(v->segment, v->index);
+        args++;
+        target = v->type;
+      }
+      name = string(target) + "." + string(word(id, i + 2));
+      i += 2;
+    } else {
+      push(Segment::Pointer, 0);
+      args++;
+      name = string(class_name) + "." + string(word(id, i));
+    }
+
+    int list = child(id, i + 2);
+    for (int k = 0; k < count(list); k += 2, args++)
+      compile_expression(child(list, k));
+    emit("call", name, args);
+  }
+};
\ No newline at end of file
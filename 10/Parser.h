@@ -1,3 +1,5 @@
+#pragma once
+
 #include <cassert>
 #include <filesystem>
 #include <fstream>
@@ -6,314 +8,409 @@
 #include <vector>
 using namespace std;
 
+#include "../common/OutputBuffer.h"
 #include "Tokenizer.h"
 
+enum class NodeKind : uint8_t {
+  Terminal, Class, ClassVarDec, SubroutineDec, ParameterList,
+  SubroutineBody, VarDec, Statements, WhileStatement, IfStatement,
+  ReturnStatement, LetStatement, DoStatement, Expression, Term,
+  ExpressionList
+};
+
+constexpr string_view node_names[] = {
+    "",
+    "class",
+    "classVarDec",
+    "subroutineDec",
+    "parameterList",
+    "subroutineBody",
+    "varDec",
+    "statements",
+    "whileStatement",
+    "ifStatement",
+    "returnStatement",
+    "letStatement",
+    "doStatement",
+    "expression",
+    "term",
+    "expressionList"};
+
+// A terminal refers to its token. The children of any other node are
+// children[first, first + count) of its Tree.
 struct Node {
-  string val;
-  bool terminal;
-  vector<Node*> children;
+  NodeKind kind;
+  int token = -1;
+  int first = 0, count = 0;
+};
 
-  Node(string val, bool terminal = false) : val(val), terminal(terminal) {}
+// The parse tree as flat arrays indexed by node id. Each node's children
+// are stored next to each other, so the whole tree is a few large blocks
+// that are freed at once.
+struct Tree {
+  vector<Token> tokens;
+  vector<Node> nodes;
+  vector<int> children;
 
-  void add_children(Node* c) { children.emplace_back(c); }
+  const Node& operator[](int id) const { return nodes[id]; }
 
-  void print(ofstream& ofs, int k = 0) {
-    if (terminal) {
-      for (int i = 0; i < k; i++) ofs << "  ";
-      ofs << val << endl;
-    } else {
-      for (int i = 0; i < k; i++) ofs << "  ";
-      ofs << "<" << val << ">" << endl;
-      for (auto c : children) {
-        c->print(ofs, k + 1);
-      }
-      for (int i = 0; i < k; i++) ofs << "  ";
-      ofs << "</" << val << ">" << endl;
+  // id of the i-th child of node
+  int child(int node, int i) const { return children[nodes[node].first + i]; }
+
+  const Token& token(int node) const { return tokens[nodes[node].token]; }
+
+  void print(OutputBuffer& ofs, int id, int k = 0) const {
+    const Node& node = nodes[id];
+    for (int i = 0; i < k; i++) ofs << "  ";
+    if (node.kind == NodeKind::Terminal) {
+      const Token& t = tokens[node.token];
+      string_view kind = kind_names[int(t.kind)];
+      ofs << "<" << kind << "> " << escape(t.word) << " </" << kind << ">\n";
+      return;
     }
+    string_view name = node_names[int(node.kind)];
+    ofs << "<" << name << ">\n";
+    for (int i = 0; i < node.count; i++)
+      print(ofs, children[node.first + i], k + 1);
+    for (int i = 0; i < k; i++) ofs << "  ";
+    ofs << "</" << name << ">\n";
   }
 };
 
+// Recursive descent over the tokens. Each parse_ function returns the id
+// of the node it built, or -1 if the input does not start with one. While
+// a node is being parsed its children wait on the pending stack, and are
+// copied out together when it is complete. Parsing carries on past a
+// syntax error; error keeps the index of the first unexpected token.
+// The tree is built in place over the given tokens, reusing the storage
+// of the previous one.
 struct Parser {
-  vector<Token> tokens;
-  Node* root;
+  Tree& tree;
+  vector<int> pending;
   int idx;
+  int error = -1;
+
+  Parser(Tree& tree) : tree(tree), idx(0) {
+    tree.nodes.clear();
+    tree.children.clear();
+    // end of input, matches no keyword or symbol
+    Token end{TokenKind::Symbol, "", 1, 1};
+    if (!tree.tokens.empty()) {
+      const Token& last = tree.tokens.back();
+      end.line = last.line;
+      end.column = last.column + last.word.size();
+    }
+    tree.tokens.push_back(end);
+    tree.nodes.reserve(tree.tokens.size() * 2);
+    tree.children.reserve(tree.tokens.size() * 2);
+  }
 
-  Parser(vector<Token> tokens) : tokens(tokens), idx(0) {}
+  const Token& next() { return tree.tokens[idx]; }
 
-  Token next() { return tokens[idx]; }
+  // whether the next token is the keyword or symbol s. String constants
+  // are stored without their quotes, so "(" must not match one.
+  bool is(string_view s) {
+    const Token& t = next();
+    return (t.kind == TokenKind::Keyword or t.kind == TokenKind::Symbol) and
+           t.word == s;
+  }
 
-  bool in(string s, vector<string> list) {
-    for (string t : list)
-      if (s == t) return true;
+  bool in(initializer_list<string_view> list) {
+    for (string_view s : list)
+      if (is(s)) return true;
     return false;
   }
 
-  Node* terminal() {
-    auto t = tokens[idx];
-    if (t.word == "<") t.word = "&lt;";
-    if (t.word == ">") t.word = "&gt;";
-    if (t.word == "\"") t.word = "&quot;";
-    if (t.word == "&") t.word = "&amp;";
-    string s = "<" + t.type + "> " + t.word + " </" + t.type + ">";
-    idx++;
-    return new Node(s, true);
+  void fail() {
+    if (error < 0) error = idx;
+  }
+
+  // Takes the next token, which must be expected if that is given. The
+  // end of input is never taken.
+  int terminal(string_view expected = "") {
+    bool end = idx + 1 == (int)tree.tokens.size();
+    if (end or (!expected.empty() and !is(expected))) fail();
+    tree.nodes.push_back({NodeKind::Terminal, idx});
+    if (!end) idx++;
+    return tree.nodes.size() - 1;
   }
 
-  Node* parse_class() {
-    if (next().word != "class") return NULL;
+  // whether parse_class() used up the tokens without an error
+  bool done() const { return error < 0 and idx + 1 == (int)tree.tokens.size(); }
+
+  void add_children(int c) {
+    if (c >= 0) pending.push_back(c);
+  }
 
-    Node* nn;  // next_node
-    auto node = new Node("class");
-    node->add_children(terminal());  // 'class'
-    node->add_children(terminal());  // className
-    node->add_children(terminal());  // '{'
-    while ((nn = parse_class_var_dec()) != NULL) {
-      node->add_children(nn);  // classVarDec
+  // Nodes are built as mark = pending.size(), add_children() for each
+  // child, then node(kind, mark).
+  int node(NodeKind kind, int mark) {
+    Node n{kind, -1, (int)tree.children.size(), (int)pending.size() - mark};
+    tree.children.insert(tree.children.end(), pending.begin() + mark,
+                         pending.end());
+    pending.resize(mark);
+    tree.nodes.push_back(n);
+    return tree.nodes.size() - 1;
+  }
+
+  int parse_class() {
+    if (!is("class")) return -1;
+
+    int nn;  // next_node
+    int mark = pending.size();
+    add_children(terminal("class"));  // 'class'
+    add_children(terminal());         // className
+    add_children(terminal("{"));      // '{'
+    while ((nn = parse_class_var_dec()) >= 0) {
+      add_children(nn);  // classVarDec
     }
-    while ((nn = parse_subroutine_dec()) != NULL) {
-      node->add_children(nn);  // subroutineDec
+    while ((nn = parse_subroutine_dec()) >= 0) {
+      add_children(nn);  // subroutineDec
     }
-    node->add_children(terminal());  // '}'
-    return node;
+    add_children(terminal("}"));  // '}'
+    return node(NodeKind::Class, mark);
   }
 
-  Node* parse_class_var_dec() {
-    if (!in(next().word, {"static", "field"})) return NULL;
+  int parse_class_var_dec() {
+    if (!in({"static", "field"})) return -1;
 
-    auto node = new Node("classVarDec");
-    node->add_children(terminal());  // 'static' | 'field'
-    node->add_children(terminal());  // type
-    node->add_children(terminal());  // varName
-    while (next().word == ",") {
-      node->add_children(terminal());  // ','
-      node->add_children(terminal());  // varName
+    int mark = pending.size();
+    add_children(terminal());  // 'static' | 'field'
+    add_children(terminal());  // type
+    add_children(terminal());  // varName
+    while (is(",")) {
+      add_children(terminal(","));  // ','
+      add_children(terminal());     // varName
     }
-    node->add_children(terminal());  // ';'
-    return node;
+    add_children(terminal(";"));  // ';'
+    return node(NodeKind::ClassVarDec, mark);
   }
 
-  Node* parse_subroutine_dec() {
-    if (!in(next().word, {"constructor", "function", "method"})) return NULL;
-
-    auto node = new Node("subroutineDec");
-    node->add_children(terminal());  // 'constructor' | 'function' | 'method'
-    node->add_children(terminal());  // 'void' | type
-    node->add_children(terminal());  // subroutineName
-    node->add_children(terminal());  // '('
-    node->add_children(parse_parameter_list());   // parameterList
-    node->add_children(terminal());               // ')'
-    node->add_children(parse_subroutine_body());  // subroutineBody
-    return node;
+  int parse_subroutine_dec() {
+    if (!in({"constructor", "function", "method"})) return -1;
+
+    int mark = pending.size();
+    add_children(terminal());  // 'constructor' | 'function' | 'method'
+    add_children(terminal());  // 'void' | type
+    add_children(terminal());  // subroutineName
+    add_children(terminal("("));            // '('
+    add_children(parse_parameter_list());   // parameterList
+    add_children(terminal(")"));            // ')'
+    add_children(parse_subroutine_body());  // subroutineBody
+    return node(NodeKind::SubroutineDec, mark);
   }
 
-  Node* parse_parameter_list() {
-    auto node = new Node("parameterList");
-    if (in(next().word, {"int", "char", "boolean"}) or
-        next().type == "identifier") {
-      node->add_children(terminal());  // type
-      node->add_children(terminal());  // varName
-
-      while (next().word == ",") {
-        node->add_children(terminal());  // ','
-        node->add_children(terminal());  // type
-        node->add_children(terminal());  // varName
+  int parse_parameter_list() {
+    int mark = pending.size();
+    if (in({"int", "char", "boolean"}) or
+        next().kind == TokenKind::Identifier) {
+      add_children(terminal());  // type
+      add_children(terminal());  // varName
+
+      while (is(",")) {
+        add_children(terminal(","));  // ','
+        add_children(terminal());     // type
+        add_children(terminal());     // varName
       }
     }
-    return node;
+    return node(NodeKind::ParameterList, mark);
   }
 
-  Node* parse_subroutine_body() {
-    Node* nn;
-    auto node = new Node("subroutineBody");
-    node->add_children(terminal());  // '{'
-    while ((nn = parse_var_dec()) != NULL) {
-      node->add_children(nn);  // varDec
+  int parse_subroutine_body() {
+    int nn;
+    int mark = pending.size();
+    add_children(terminal("{"));  // '{'
+    while ((nn = parse_var_dec()) >= 0) {
+      add_children(nn);  // varDec
     }
-    node->add_children(parse_statements());  // statements
-    node->add_children(terminal());          // '}'
-    return node;
+    add_children(parse_statements());  // statements
+    add_children(terminal("}"));       // '}'
+    return node(NodeKind::SubroutineBody, mark);
   }
 
-  Node* parse_var_dec() {
-    if (next().word != "var") return NULL;
-    auto node = new Node("varDec");
-    node->add_children(terminal());  // var
-    node->add_children(terminal());  // type
-    node->add_children(terminal());  // varName
-    while (next().word == ",") {
-      node->add_children(terminal());  // ','
-      node->add_children(terminal());  // varName
+  int parse_var_dec() {
+    if (!is("var")) return -1;
+    int mark = pending.size();
+    add_children(terminal());  // var
+    add_children(terminal());  // type
+    add_children(terminal());  // varName
+    while (is(",")) {
+      add_children(terminal(","));  // ','
+      add_children(terminal());     // varName
     }
-    node->add_children(terminal());  // ';'
-    return node;
+    add_children(terminal(";"));  // ';'
+    return node(NodeKind::VarDec, mark);
   }
 
-  Node* parse_statements() {
-    auto node = new Node("statements");
+  int parse_statements() {
+    int mark = pending.size();
     while (1) {
-      Node* nn;
-      if ((nn = parse_while_statements()) != NULL) {
-        node->add_children(nn);
+      int nn;
+      if ((nn = parse_while_statements()) >= 0) {
+        add_children(nn);
         continue;
       }
-      if ((nn = parse_if_statements()) != NULL) {
-        node->add_children(nn);
+      if ((nn = parse_if_statements()) >= 0) {
+        add_children(nn);
         continue;
       }
-      if ((nn = parse_return_statements()) != NULL) {
-        node->add_children(nn);
+      if ((nn = parse_return_statements()) >= 0) {
+        add_children(nn);
         continue;
       }
-      if ((nn = parse_let_statements()) != NULL) {
-        node->add_children(nn);
+      if ((nn = parse_let_statements()) >= 0) {
+        add_children(nn);
         continue;
       }
-      if ((nn = parse_do_statements()) != NULL) {
-        node->add_children(nn);
+      if ((nn = parse_do_statements()) >= 0) {
+        add_children(nn);
         continue;
       }
       break;
     }
-    return node;
+    return node(NodeKind::Statements, mark);
   }
 
-  Node* parse_while_statements() {
-    if (next().word != "while") return NULL;
-
-    auto node = new Node("whileStatement");
-    node->add_children(terminal());          // 'while'
-    node->add_children(terminal());          // '('
-    node->add_children(parse_expression());  // expression
-    node->add_children(terminal());          // ')'
-    node->add_children(terminal());          // '{'
-    node->add_children(parse_statements());  // statements
-    node->add_children(terminal());          // '}'
-    return node;
+  int parse_while_statements() {
+    if (!is("while")) return -1;
+
+    int mark = pending.size();
+    add_children(terminal("while"));   // 'while'
+    add_children(terminal("("));       // '('
+    add_children(parse_expression());  // expression
+    add_children(terminal(")"));       // ')'
+    add_children(terminal("{"));       // '{'
+    add_children(parse_statements());  // statements
+    add_children(terminal("}"));       // '}'
+    return node(NodeKind::WhileStatement, mark);
   }
 
-  Node* parse_if_statements() {
-    if (next().word != "if") return NULL;
-
-    auto node = new Node("ifStatement");
-    node->add_children(terminal());          // 'if'
-    node->add_children(terminal());          // '('
-    node->add_children(parse_expression());  // expression
-    node->add_children(terminal());          // ')'
-    node->add_children(terminal());          // '{'
-    node->add_children(parse_statements());  // statements
-    node->add_children(terminal());          // '}'
-    if (next().word == "else") {
-      node->add_children(terminal());          // 'else'
-      node->add_children(terminal());          // '{'
-      node->add_children(parse_statements());  // statements
-      node->add_children(terminal());          // '}'
+  int parse_if_statements() {
+    if (!is("if")) return -1;
+
+    int mark = pending.size();
+    add_children(terminal("if"));      // 'if'
+    add_children(terminal("("));       // '('
+    add_children(parse_expression());  // expression
+    add_children(terminal(")"));       // ')'
+    add_children(terminal("{"));       // '{'
+    add_children(parse_statements());  // statements
+    add_children(terminal("}"));       // '}'
+    if (is("else")) {
+      add_children(terminal("else"));    // 'else'
+      add_children(terminal("{"));       // '{'
+      add_children(parse_statements());  // statements
+      add_children(terminal("}"));       // '}'
     }
-    // node->add_children(terminal());          // '}'
-    return node;
+    // add_children(terminal());          // '}'
+    return node(NodeKind::IfStatement, mark);
   }
 
-  Node* parse_return_statements() {
-    if (next().word != "return") return NULL;
+  int parse_return_statements() {
+    if (!is("return")) return -1;
 
-    Node* nn;
-    auto node = new Node("returnStatement");
-    node->add_children(terminal());  // 'return'
-    if ((nn = parse_expression()) != NULL) {
-      node->add_children(nn);  // expression
+    int nn;
+    int mark = pending.size();
+    add_children(terminal("return"));  // 'return'
+    if (!is(";") and (nn = parse_expression()) >= 0) {
+      add_children(nn);  // expression
     }
-    node->add_children(terminal());  // ';'
-    return node;
+    add_children(terminal(";"));  // ';'
+    return node(NodeKind::ReturnStatement, mark);
   }
 
-  Node* parse_let_statements() {
-    if (next().word != "let") return NULL;
+  int parse_let_statements() {
+    if (!is("let")) return -1;
 
-    auto node = new Node("letStatement");
-    node->add_children(terminal());  // 'let'
-    node->add_children(terminal());  // varName
-    if (next().word == "[") {
-      node->add_children(terminal());          // '['
-      node->add_children(parse_expression());  // expression
-      node->add_children(terminal());          // ']'
+    int mark = pending.size();
+    add_children(terminal("let"));  // 'let'
+    add_children(terminal());       // varName
+    if (is("[")) {
+      add_children(terminal("["));       // '['
+      add_children(parse_expression());  // expression
+      add_children(terminal("]"));       // ']'
     }
-    node->add_children(terminal());          // '='
-    node->add_children(parse_expression());  // expression
-    node->add_children(terminal());          // ';'
-    return node;
+    add_children(terminal("="));       // '='
+    add_children(parse_expression());  // expression
+    add_children(terminal(";"));       // ';'
+    return node(NodeKind::LetStatement, mark);
   }
 
-  Node* parse_do_statements() {
-    if (next().word != "do") return NULL;
+  int parse_do_statements() {
+    if (!is("do")) return -1;
 
-    auto node = new Node("doStatement");
-    node->add_children(terminal());  // 'do'
-    node->add_children(terminal());  // subroutineName | (className | varName)
-    if (next().word == ".") {
-      node->add_children(terminal());  // '.'
-      node->add_children(terminal());  // subroutineName
+    int mark = pending.size();
+    add_children(terminal("do"));  // 'do'
+    add_children(terminal());      // subroutineName | (className | varName)
+    if (is(".")) {
+      add_children(terminal("."));  // '.'
+      add_children(terminal());     // subroutineName
     }
-    node->add_children(terminal());               // '('
-    node->add_children(parse_expression_list());  // expressionList
-    node->add_children(terminal());               // ')'
-    node->add_children(terminal());               // ';'
-    return node;
+    add_children(terminal("("));            // '('
+    add_children(parse_expression_list());  // expressionList
+    add_children(terminal(")"));            // ')'
+    add_children(terminal(";"));            // ';'
+    return node(NodeKind::DoStatement, mark);
   }
 
-  Node* parse_expression() {
-    Node* nn;
-    auto node = new Node("expression");
-    if ((nn = parse_term()) == NULL) return NULL;
-    node->add_children(nn);  // term
-    while (in(next().word, {"+", "-", "*", "/", "&", "|", "<", ">", "="})) {
-      node->add_children(terminal());    // op
-      node->add_children(parse_term());  // term
+  int parse_expression() {
+    int nn;
+    int mark = pending.size();
+    if ((nn = parse_term()) < 0) return -1;
+    add_children(nn);  // term
+    while (in({"+", "-", "*", "/", "&", "|", "<", ">", "="})) {
+      add_children(terminal());    // op
+      add_children(parse_term());  // term
     }
-    return node;
+    return node(NodeKind::Expression, mark);
   }
 
-  Node* parse_term() {
-    if (next().type != "identifier" and next().type != "stringConstant" and
-        next().type != "integerConstant" and
-        !in(next().word, {"(", "-", "~", "true", "false", "null", "this"}))
-      return NULL;
-
-    auto node = new Node("term");
-    if (next().word == "(") {
-      node->add_children(terminal());          // '('
-      node->add_children(parse_expression());  // expression
-      node->add_children(terminal());          // ')'
-    } else if (in(next().word, {"-", "~"})) {
-      node->add_children(terminal());    // unaryOp
-      node->add_children(parse_term());  // term
+  int parse_term() {
+    if (next().kind != TokenKind::Identifier and
+        next().kind != TokenKind::StringConstant and
+        next().kind != TokenKind::IntegerConstant and
+        !in({"(", "-", "~", "true", "false", "null", "this"})) {
+      fail();
+      return -1;
+    }
+
+    int mark = pending.size();
+    if (is("(")) {
+      add_children(terminal("("));       // '('
+      add_children(parse_expression());  // expression
+      add_children(terminal(")"));       // ')'
+    } else if (in({"-", "~"})) {
+      add_children(terminal());    // unaryOp
+      add_children(parse_term());  // term
     } else {
-      node->add_children(terminal());  // start is always identifier
-      if (in(next().word, {".", "("})) {
-        if (next().word == ".") {
-          node->add_children(terminal());  // '.'
-          node->add_children(terminal());  // subroutineName
+      add_children(terminal());  // start is always identifier
+      if (in({".", "("})) {
+        if (is(".")) {
+          add_children(terminal("."));  // '.'
+          add_children(terminal());     // subroutineName
         }
-        node->add_children(terminal());               // '('
-        node->add_children(parse_expression_list());  // expressionList
-        node->add_children(terminal());               // ')'
-      } else if (next().word == "[") {
-        node->add_children(terminal());          // "["
-        node->add_children(parse_expression());  // expression
-        node->add_children(terminal());          // "]"
+        add_children(terminal("("));            // '('
+        add_children(parse_expression_list());  // expressionList
+        add_children(terminal(")"));            // ')'
+      } else if (is("[")) {
+        add_children(terminal("["));       // "["
+        add_children(parse_expression());  // expression
+        add_children(terminal("]"));       // "]"
       }
     }
-    return node;
+    return node(NodeKind::Term, mark);
   }
 
-  Node* parse_expression_list() {
-    Node* nn;
-    auto node = new Node("expressionList");
-    if ((nn = parse_expression()) != NULL) {
-      node->add_children(nn);  // expression
-      while (next().word == ",") {
-        node->add_children(terminal());          // ','
-        node->add_children(parse_expression());  // expression
+  int parse_expression_list() {
+    int nn;
+    int mark = pending.size();
+    if (!is(")") and (nn = parse_expression()) >= 0) {
+      add_children(nn);  // expression
+      while (is(",")) {
+        add_children(terminal(","));       // ','
+        add_children(parse_expression());  // expression
       }
     }
-    return node;
+    return node(NodeKind::ExpressionList, mark);
   }
 };
\ No newline at end of file
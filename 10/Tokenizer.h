@@ -1,113 +1,187 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 using namespace std;
 
-struct Token {
-  string word, type;
+#include "../common/MappedFile.h"
 
-  Token(string word, string type) : word(word), type(type) {}
+enum class TokenKind : uint8_t {
+  Keyword, Symbol, IntegerConstant, StringConstant, Identifier
 };
 
-struct Tokenizer {
-  string s;
-  vector<Token> tokens;
-
-  Tokenizer(string inputfile) {
-    ifstream ifs(inputfile);
-    string t;
-    bool comment = false;
-    while (getline(ifs, t)) {
-      s += erase_comment(t, comment);
-    }
+constexpr string_view kind_names[] = {"keyword", "symbol", "integerConstant",
+                                      "stringConstant", "identifier"};
+
+// The word views the mapped source; a string constant is stored without
+// its quotes.
+struct Token {
+  TokenKind kind;
+  string_view word;
+  int line, column;
+};
+
+// XML spelling of a token
+inline string_view escape(string_view word) {
+  if (word == "<") return "&lt;";
+  if (word == ">") return "&gt;";
+  if (word == "\"") return "&quot;";
+  if (word == "&") return "&amp;";
+  return word;
+}
+
+constexpr string_view keywords[] = {
+    "class", "constructor", "function", "method",  "field", "static",
+    "var",   "int",         "char",     "boolean", "void",  "true",
+    "false", "null",        "this",     "let",     "do",    "if",
+    "else",  "while",       "return"};
+
+// Perfect hash of the keywords on their first and last characters and
+// length, checked for collisions at compile time. A lookup is one hash
+// and at most one comparison.
+struct KeywordTable {
+  static constexpr int size = 32;
+  int8_t slots[size] = {};
+
+  static constexpr int hash(string_view s) {
+    return (8 * s.front() + 7 * s.back() + 5 * (int)s.size()) & (size - 1);
   }
 
-  string erase_comment(string s, bool& comment) {
-    int n = s.size();
-    string ret = "";
-    for (int i = 0; i < n; i++) {
-      if (comment) {
-        if (i + 1 < n and s.substr(i, 2) == "*/") i++, comment = false;
-      } else {
-        if (i + 1 < n and s.substr(i, 2) == "//") break;
-        if (i + 1 < n and s.substr(i, 2) == "/*") {
-          comment = true;
-          continue;
-        }
-        ret += s[i];
-      }
+  constexpr KeywordTable() {
+    for (auto& slot : slots) slot = -1;
+    int k = 0;
+    for (auto keyword : keywords) {
+      int i = hash(keyword);
+      if (slots[i] >= 0) throw "keyword hash collision";
+      slots[i] = k++;
     }
-    return ret;
   }
 
-  vector<Token> analyze() {
-    string word = "", type = "None";
-    const string symbols = "{}()[].,;+-*/&|<>=_~";
-    const string keywords[] = {
-        "class", "constructor", "function", "method",  "field", "static",
-        "var",   "int",         "char",     "boolean", "void",  "true",
-        "false", "null",        "this",     "let",     "do",    "if",
-        "else",  "while",       "return"};
-    vector<Token> tokens;
-    for (auto c : s) {
-      if (type == "stringConstant") {
-        if (c == '\"') {
-          tokens.emplace_back(word, type);
-          word = "";
-          type = "";
-        } else
-          word += c;
-      } else if (is_idint_chars(c)) {
-        if (type.empty()) {
-          type = is_digit(c) ? "integerConstant" : "identifier";
-        }
-        word += c;
-      } else {
-        if (!word.empty()) {
-          // keyword
-          for (auto keyword : keywords) {
-            if (word == keyword) {
-              type = "keyword";
-              break;
-            }
-          }
-
-          tokens.emplace_back(word, type);
-        }
+  // returns the index in keywords, -1 for an identifier
+  constexpr int find(string_view s) const {
+    int k = slots[hash(s)];
+    return k >= 0 and keywords[k] == s ? k : -1;
+  }
+};
 
-        word = "";
-        type = "";
+constexpr KeywordTable keyword_table;
 
-        if (is_space(c)) continue;
+enum class CharKind : uint8_t { Other, Space, Digit, Letter, Symbol };
 
-        // stringconstant
-        if (c == '\"') {
-          type = "stringConstant";
-          continue;
-        }
+struct CharTable {
+  CharKind kind[256] = {};
 
-        // symbol
-        for (auto symbol : symbols) {
-          if (c == symbol) {
-            tokens.emplace_back(string(1, c), "symbol");
-          }
-        }
-      }
-    }
-    return tokens;
+  constexpr void set(string_view chars, CharKind k) {
+    for (char c : chars) kind[(unsigned char)c] = k;
   }
 
-  bool is_idint_chars(char c) {
-    if ('a' <= c and c <= 'z') return true;
-    if ('A' <= c and c <= 'Z') return true;
-    return is_digit(c);
+  constexpr CharTable() {
+    set(" \t\r\n", CharKind::Space);
+    set("0123456789", CharKind::Digit);
+    set("abcdefghijklmnopqrstuvwxyz_", CharKind::Letter);
+    set("ABCDEFGHIJKLMNOPQRSTUVWXYZ", CharKind::Letter);
+    set("{}()[].,;+-*/&|<>=~", CharKind::Symbol);
+  }
+
+  CharKind operator[](char c) const { return kind[(unsigned char)c]; }
+};
+
+constexpr CharTable char_table;
+
+// Single pass over the mapped source. Tokens view the mapping, so they
+// stay valid as long as the Tokenizer. Errors are reported to err with
+// their line and column and the offending text is skipped.
+struct Tokenizer {
+  string filename;
+  MappedFile source;
+  ostream& err;
+
+  Tokenizer(const string& inputfile, ostream& err = cerr)
+      : filename(inputfile), source(inputfile), err(err) {
+    if (!source.ok) err << "Cannot open " << inputfile << endl;
   }
 
-  bool is_digit(char c) { return '0' <= c and c <= '9'; }
+  // Replaces the contents of tokens, reusing its storage. Returns false
+  // if any error was reported.
+  bool analyze(vector<Token>& tokens) {
+    tokens.clear();
+    string_view text = source.text();
+    size_t i = 0, line_start = 0;
+    int line = 1;
+    bool ok = true;
+    auto fail = [&](size_t at, const string& msg) {
+      ok = false;
+      err << filename << ":" << line << ":" << at - line_start + 1 << ": "
+          << msg << endl;
+    };
+
+    while (i < text.size()) {
+      char c = text[i];
+      if (c == '\n') {
+        line++;
+        line_start = ++i;
+        continue;
+      }
+      if (char_table[c] == CharKind::Space) {
+        i++;
+        continue;
+      }
+      if (c == '/' and text.substr(i, 2) == "//") {
+        i = text.find('\n', i);
+        if (i == string_view::npos) i = text.size();
+        continue;
+      }
+      if (c == '/' and text.substr(i, 2) == "/*") {
+        size_t end = text.find("*/", i + 2);
+        if (end == string_view::npos) {
+          fail(i, "unterminated comment");
+          break;
+        }
+        for (; i < end; i++)
+          if (text[i] == '\n') line++, line_start = i + 1;
+        i = end + 2;
+        continue;
+      }
 
-  bool is_space(char c) { return c == ' ' or c == '\t'; }
+      Token t{TokenKind::Symbol, text.substr(i, 1), line,
+              int(i - line_start + 1)};
+      size_t j = i + 1;
+      if (c == '"') {
+        while (j < text.size() and text[j] != '"' and text[j] != '\n') j++;
+        if (j == text.size() or text[j] != '"') {
+          fail(i, "unterminated string");
+          i = j;
+          continue;
+        }
+        t.kind = TokenKind::StringConstant;
+        t.word = text.substr(i + 1, j - i - 1);
+        j++;
+      } else if (char_table[c] == CharKind::Digit) {
+        while (j < text.size() and char_table[text[j]] == CharKind::Digit)
+          j++;
+        t.kind = TokenKind::IntegerConstant;
+        t.word = text.substr(i, j - i);
+      } else if (char_table[c] == CharKind::Letter) {
+        while (j < text.size() and
+               (char_table[text[j]] == CharKind::Letter or
+                char_table[text[j]] == CharKind::Digit))
+          j++;
+        t.word = text.substr(i, j - i);
+        t.kind = keyword_table.find(t.word) >= 0 ? TokenKind::Keyword
+                                                 : TokenKind::Identifier;
+      } else if (char_table[c] != CharKind::Symbol) {
+        fail(i, string("unexpected character '") + c + "'");
+        i++;
+        continue;
+      }
+      tokens.emplace_back(t);
+      i = j;
+    }
+    return ok;
+  }
 };
\ No newline at end of file
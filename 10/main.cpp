@@ -1,32 +1,160 @@
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <sstream>
+
+#include "../common/Parallel.h"
+#include "Compiler.h"
 #include "Parser.h"
 #include "Tokenizer.h"
 
+void write_tokens(const string& outfile, const vector<Token>& tokens) {
+  OutputBuffer ofs(outfile);
+  ofs << "<tokens>\n";
+  for (auto& t : tokens) {
+    string_view type = kind_names[int(t.kind)];
+    ofs << "<" << type << "> " << escape(t.word) << " </" << type << ">\n";
+  }
+  ofs << "</tokens>\n";
+}
+
+// Buffers kept by each thread from one file to the next, so that once
+// they have grown to the largest file compiling allocates next to nothing.
+struct Workspace {
+  Tree tree;
+  string code;
+};
+
+thread_local Workspace workspace;
+
+// What compiling one file left behind. Diagnostics are collected here
+// rather than written as they happen, so they come out in file order
+// whatever the thread that compiled the file.
+struct Result {
+  bool ok = false;
+  string log;
+  size_t tokens = 0;
+  double ms = 0;
+};
+
+// Compiles X.jack to X.vm; with --xml also writes the tokens to XT_.xml
+// and the parse tree to X_.xml.
+bool compile(const string& inputfile, bool xml, ostream& err,
+             size_t& ntokens) {
+  string basename = inputfile.substr(0, inputfile.size() - 5);
+  Tokenizer tokenizer(inputfile, err);
+  if (!tokenizer.source.ok) return false;
+  Tree& tree = workspace.tree;
+  bool lexed = tokenizer.analyze(tree.tokens);
+  ntokens = tree.tokens.size();
+  if (!lexed) return false;
+  if (xml) write_tokens(basename + "T_.xml", tree.tokens);
+
+  Parser parser(tree);
+  int root = parser.parse_class();
+  if (root < 0 or !parser.done()) {
+    const Token& t = parser.error >= 0 ? tree.tokens[parser.error]
+                                       : parser.next();
+    err << inputfile << ":" << t.line << ":" << t.column << ": syntax error"
+        << endl;
+    return false;
+  }
+  if (xml) {
+    OutputBuffer ofs(basename + "_.xml");
+    tree.print(ofs, root);
+  }
+
+  Compiler compiler(tree, inputfile, workspace.code, err);
+  compiler.compile_class(root);
+  if (!compiler.ok) return false;
+  OutputBuffer ofs(basename + ".vm");
+  ofs << compiler.code;
+  if (!ofs.close()) {
+    err << "Cannot write " << basename << ".vm" << endl;
+    return false;
+  }
+  return true;
+}
+
+double since(chrono::steady_clock::time_point start) {
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start)
+      .count();
+}
+
 int main(int argc, char* argv[]) {
-  string inputfile = argv[1];
-  for (const auto& entry : std::filesystem::directory_iterator(inputfile)) {
-    string p = entry.path();
-    if (p.substr(p.size() - 5, 5) != ".jack") continue;
-    string outfile = p.substr(0, p.size() - 5) + "T_.xml";
-    ofstream ofs(outfile);
-    Tokenizer tokenizer(p);
-    auto tokens = tokenizer.analyze();
-
-    ofs << "<tokens>" << endl;
-    for (auto t : tokens) {
-      if (t.word == "<") t.word = "&lt;";
-      if (t.word == ">") t.word = "&gt;";
-      if (t.word == "\"") t.word = "&quot;";
-      if (t.word == "&") t.word = "&amp;";
-      ofs << "<" << t.type << "> " << t.word << " </" << t.type << ">" << endl;
+  string inputfile;
+  bool xml = false, timing = false;
+  int jobs = 1;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--xml")
+      xml = true;
+    else if (arg == "--time")
+      timing = true;
+    else if (arg.substr(0, 7) == "--jobs=")
+      jobs = max(1, atoi(arg.c_str() + 7));
+    else
+      inputfile = arg;
+  }
+  if (inputfile.empty()) {
+    cerr << "Usage: JackCompiler [--xml] [--time] [--jobs=N] file.jack|dir"
+         << endl;
+    return -1;
+  }
+
+  auto is_jack = [](const string& p) {
+    return p.size() > 5 and p.substr(p.size() - 5) == ".jack";
+  };
+  vector<string> files;
+  if (is_jack(inputfile)) {
+    files.emplace_back(inputfile);
+  } else if (std::filesystem::is_directory(inputfile)) {
+    for (const auto& entry : std::filesystem::directory_iterator(inputfile)) {
+      string p = entry.path();
+      if (is_jack(p)) files.emplace_back(p);
     }
-    ofs << "</tokens>" << endl;
+    sort(files.begin(), files.end());
+  } else {
+    cerr << "Cannot open " << inputfile << endl;
+    return -1;
+  }
 
-    auto parser = Parser(tokens);
-    auto r = parser.parse_class();
-    string outfile2 = p.substr(0, p.size() - 5) + "_.xml";
-    ofstream ofs2(outfile2);
-    r->print(ofs2);
+  // Classes compile independently. Handing out the largest files first
+  // keeps one big class from starting last and finishing alone.
+  auto start = chrono::steady_clock::now();
+  vector<size_t> sizes(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    error_code ec;
+    sizes[i] = std::filesystem::file_size(files[i], ec);
   }
+  vector<int> order(files.size());
+  iota(order.begin(), order.end(), 0);
+  stable_sort(order.begin(), order.end(),
+              [&](int a, int b) { return sizes[a] > sizes[b]; });
 
-  return 0;
+  vector<Result> results(files.size());
+  parallel(files.size(), jobs, [&](int k) {
+    int i = order[k];
+    auto file_start = chrono::steady_clock::now();
+    ostringstream err;
+    results[i].ok = compile(files[i], xml, err, results[i].tokens);
+    results[i].log = err.str();
+    results[i].ms = since(file_start);
+  });
+
+  bool ok = true;
+  size_t tokens = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    cerr << results[i].log;
+    if (timing)
+      cerr << files[i] << ": " << results[i].tokens << " tokens, "
+           << results[i].ms << " ms" << endl;
+    ok = ok and results[i].ok;
+    tokens += results[i].tokens;
+  }
+  if (timing)
+    cerr << "total: " << files.size() << " files, " << tokens << " tokens, "
+         << since(start) << " ms on " << min<size_t>(jobs, files.size())
+         << " threads" << endl;
+  return ok ? 0 : -1;
 }
\ No newline at end of file
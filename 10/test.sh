@@ -0,0 +1,120 @@
+#!/bin/bash
+# Regression tests for the Jack compiler.
+set -u
+cd "$(dirname "$0")"
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+g++ -std=c++17 -O2 -Wall -pthread main.cpp -o "$dir/JackCompiler" || exit 1
+g++ -std=c++17 -O2 -pthread ../08/VMtranslator.cpp -o "$dir/VMtranslator" ||
+  exit 1
+g++ -std=c++17 -O2 -pthread ../06/emulator.cpp -o "$dir/emulator" || exit 1
+
+failed=0
+check() {
+  if [ "$2" != "$3" ]; then
+    echo "FAIL $1: got '$2', expected '$3'"
+    failed=1
+  fi
+}
+
+# string constants are stored without quotes and must not be taken for
+# the symbols or keywords they spell
+mkdir "$dir/strings"
+cat > "$dir/strings/Main.jack" <<'JACK'
+class Main {
+  function void main() {
+    do Output.printString("-");
+    do Output.printString("~");
+    do Output.printString("(");
+    do Output.printString(")");
+    do Output.printString(",");
+    do Output.printString(";");
+    do Output.printString("class");
+    do Main.pair("(", ")");
+    return;
+  }
+}
+JACK
+"$dir/JackCompiler" "$dir/strings" 2> "$dir/err"
+check "strings exit" "$?" 0
+check "strings stderr" "$(cat "$dir/err")" ""
+check "strings count" "$(grep -c 'call String.new 1' "$dir/strings/Main.vm")" 9
+check "strings args" "$(grep -c 'call Main.pair 2' "$dir/strings/Main.vm")" 1
+
+# lexer errors fail the file and leave no output behind
+for source in 'do Main.f(); #' 'let s = "open;' '/* never closed'; do
+  rm -rf "$dir/lex"
+  mkdir "$dir/lex"
+  printf 'class Main {\n  function void main() {\n    %s\n    return;\n  }\n}\n' \
+    "$source" > "$dir/lex/Main.jack"
+  "$dir/JackCompiler" --xml "$dir/lex" 2> /dev/null
+  check "lex '$source' exit" "$?" 255
+  check "lex '$source' output" "$(ls "$dir/lex")" "Main.jack"
+done
+
+# constant folding, simplified unary ops and reduced multiply/divide give
+# the values Math and the VM would; Main.id keeps an operand from folding
+mkdir "$dir/arith"
+cat > "$dir/arith/Main.jack" <<'JACK'
+class Main {
+  function int id(int x) {
+    return x;
+  }
+  function void main() {
+    var Array a;
+    let a = 8000;
+    let a[0] = (3 + 4) * 2 - 1;
+    let a[1] = -7 / 2;
+    let a[2] = 100 * -4;
+    let a[3] = 20000 < -20000;
+    let a[4] = 20000 > -20000;
+    let a[5] = Main.id(20000) < -20000;
+    let a[6] = ~(~Main.id(-5));
+    let a[7] = -(-(Main.id(9)));
+    let a[8] = Main.id(123) + 0;
+    let a[9] = 0 | Main.id(77);
+    let a[10] = Main.id(5) * 0;
+    let a[11] = Main.id(5) * -4;
+    let a[12] = Main.id(-3) * 10;
+    let a[13] = 8 * Main.id(-6);
+    let a[14] = Main.id(-7) / 2;
+    let a[15] = Main.id(7) / 2;
+    let a[16] = Main.id(-9) / -8;
+    let a[17] = Main.id(100) / -8;
+    let a[18] = Main.id(-32767) / 16384;
+    let a[19] = Main.id(-32767 - 1) / 2;
+    return;
+  }
+}
+JACK
+cat > "$dir/arith/Sys.jack" <<'JACK'
+class Sys {
+  function void init() {
+    do Main.main();
+    while (true) {
+    }
+    return;
+  }
+}
+JACK
+"$dir/JackCompiler" "$dir/arith" 2> "$dir/err"
+check "arith exit" "$?" 0
+check "arith stderr" "$(cat "$dir/err")" ""
+check "arith Math calls" "$(grep -c 'call Math' "$dir/arith/Main.vm")" 0
+check "arith shifts" "$(grep -c '^function Main.\$div' "$dir/arith/Main.vm")" 3
+expected=
+address=8000
+for value in 13 -3 -400 -1 0 -1 -5 9 123 77 0 -20 -30 -48 -3 3 1 -12 -1 \
+  -16384; do
+  expected+="RAM[$address] = $value"$'\n'
+  address=$((address + 1))
+done
+for options in "" "-O --tos"; do
+  "$dir/VMtranslator" $options --format=hack "$dir/arith" 2> /dev/null
+  got=$("$dir/emulator" --max-cycles=1000000 --dump=8000:8019 \
+    "$dir/arith/arith.hack" 2> /dev/null)
+  check "arith values ($options)" "$got" "${expected%$'\n'}"
+done
+
+[ $failed = 0 ] && echo "all tests passed"
+exit $failed
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+using namespace std;
+
+// Instruction encoding of the Hack machine language, shared by the
+// assembler and the tools that produce or execute Hack machine code.
+
+// Mnemonics are at most 3 bytes, so they are packed into an integer key.
+// Spaces are skipped so that "D + 1" and "D+1" map to the same key.
+constexpr uint32_t pack(string_view s) {
+  uint32_t key = 0;
+  for (char c : s) {
+    if (c == ' ' or c == '\t') continue;
+    key = key << 8 | (unsigned char)c;
+  }
+  return key;
+}
+
+// a-bit and c-bits of every comp mnemonic
+struct Comp {
+  const char *mnemonic;
+  uint16_t bits;
+};
+
+constexpr Comp comps[] = {
+    {"0", 0b0101010},   {"1", 0b0111111},   {"-1", 0b0111010},
+    {"D", 0b0001100},   {"A", 0b0110000},   {"!D", 0b0001101},
+    {"!A", 0b0110001},  {"-D", 0b0001111},  {"-A", 0b0110011},
+    {"D+1", 0b0011111}, {"A+1", 0b0110111}, {"D-1", 0b0001110},
+    {"A-1", 0b0110010}, {"D+A", 0b0000010}, {"A+D", 0b0000010},
+    {"D-A", 0b0010011}, {"A-D", 0b0000111}, {"D&A", 0b0000000},
+    {"A&D", 0b0000000}, {"D|A", 0b0010101}, {"A|D", 0b0010101},
+    {"M", 0b1110000},   {"!M", 0b1110001},  {"-M", 0b1110011},
+    {"M+1", 0b1110111}, {"M-1", 0b1110010}, {"D+M", 0b1000010},
+    {"M+D", 0b1000010}, {"D-M", 0b1010011}, {"M-D", 0b1000111},
+    {"D&M", 0b1000000}, {"M&D", 0b1000000}, {"D|M", 0b1010101},
+    {"M|D", 0b1010101},
+};
+
+// Open addressing table over the packed comp keys, built at compile time.
+// Every key lands within a couple of probes, and lookups touch no heap.
+struct CompTable {
+  static constexpr int size = 128;
+  uint32_t keys[size] = {};
+  uint16_t bits[size] = {};
+
+  static constexpr int hash(uint32_t key) {
+    return (key * 2654435761u) >> 25;
+  }
+
+  constexpr CompTable() {
+    for (auto &c : comps) {
+      uint32_t key = pack(c.mnemonic);
+      int i = hash(key);
+      while (keys[i] != 0) i = (i + 1) % size;
+      keys[i] = key;
+      bits[i] = c.bits;
+    }
+  }
+
+  // returns -1 for an unknown mnemonic
+  constexpr int find(string_view s) const {
+    uint32_t key = pack(s);
+    for (int i = hash(key); keys[i] != 0; i = (i + 1) % size)
+      if (keys[i] == key) return bits[i];
+    return -1;
+  }
+};
+
+constexpr CompTable comp_table;
+
+inline int dest_bits(string_view s) {
+  int d = 0;
+  for (char c : s) {
+    if (c == 'A')
+      d |= 0b100;
+    else if (c == 'D')
+      d |= 0b010;
+    else if (c == 'M')
+      d |= 0b001;
+    else if (c != ' ' and c != '\t')
+      return -1;
+  }
+  return d;
+}
+
+inline int jump_bits(string_view s) {
+  switch (pack(s)) {
+    case pack(""):
+      return 0b000;
+    case pack("JGT"):
+      return 0b001;
+    case pack("JEQ"):
+      return 0b010;
+    case pack("JGE"):
+      return 0b011;
+    case pack("JLT"):
+      return 0b100;
+    case pack("JNE"):
+      return 0b101;
+    case pack("JLE"):
+      return 0b110;
+    case pack("JMP"):
+      return 0b111;
+  }
+  return -1;
+}
+
+// symbols every program can use without defining them
+struct Predefined {
+  const char *name;
+  uint16_t address;
+};
+
+constexpr Predefined predefined[] = {
+    {"R0", 0},   {"R1", 1},   {"R2", 2},   {"R3", 3},   {"R4", 4},
+    {"R5", 5},   {"R6", 6},   {"R7", 7},   {"R8", 8},   {"R9", 9},
+    {"R10", 10}, {"R11", 11}, {"R12", 12}, {"R13", 13}, {"R14", 14},
+    {"R15", 15}, {"SP", 0},   {"LCL", 1},  {"ARG", 2},  {"THIS", 3},
+    {"THAT", 4}, {"SCREEN", 16384},        {"KBD", 24576},
+};
+
+// returns the 16-bit word, or -1 if any field is not a valid mnemonic
+inline int encode_c(string_view dest, string_view comp, string_view jump) {
+  int c = comp_table.find(comp);
+  int d = dest_bits(dest);
+  int j = jump_bits(jump);
+  if (c < 0 or d < 0 or j < 0) return -1;
+  return 0b111 << 13 | c << 6 | d << 3 | j;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+using namespace std;
+
+// Read-only view of a whole file mapped into memory.
+// The mapping lives as long as this object, so string_views into text()
+// stay valid until it is destroyed.
+struct MappedFile {
+  const char* data = nullptr;
+  size_t size = 0;
+  bool ok = false;
+
+  MappedFile(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      size = st.st_size;
+      if (size == 0) {
+        ok = true;
+      } else {
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+          madvise(p, size, MADV_SEQUENTIAL);
+          data = (const char*)p;
+          ok = true;
+        }
+      }
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (data) munmap((void*)data, size);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  string_view text() const { return string_view(data, size); }
+};
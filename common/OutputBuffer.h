@@ -0,0 +1,94 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <string>
+#include <string_view>
+using namespace std;
+
+// Write-only file sink for generated code. Output accumulates in one large
+// buffer that goes to the file in a single syscall whenever it fills up,
+// so emitting a line costs a copy instead of a flush. Blocks larger than
+// the buffer are written straight from the caller's memory, together with
+// whatever is pending, by one writev.
+struct OutputBuffer {
+  static constexpr size_t capacity = 1 << 20;
+
+  int fd = -1;
+  bool ok = false;
+  size_t bytes = 0;  // emitted so far
+  int writes = 0;    // syscalls issued
+  string buf;
+
+  OutputBuffer(const string& path) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ok = fd >= 0;
+    buf.reserve(capacity);
+  }
+
+  ~OutputBuffer() { close(); }
+
+  OutputBuffer(const OutputBuffer&) = delete;
+  OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+  OutputBuffer& operator<<(string_view s) {
+    if (buf.size() + s.size() <= capacity) {
+      buf.append(s);
+    } else if (s.size() < capacity) {
+      flush();
+      buf.append(s);
+    } else {
+      iovec iov[2] = {{buf.data(), buf.size()}, {(void*)s.data(), s.size()}};
+      write_all(iov, 2);
+      buf.clear();
+    }
+    bytes += s.size();
+    return *this;
+  }
+
+  OutputBuffer& operator<<(char c) { return *this << string_view(&c, 1); }
+
+  OutputBuffer& operator<<(int value) {
+    char digits[12];
+    auto [end, ec] = to_chars(digits, digits + sizeof digits, value);
+    return *this << string_view(digits, end - digits);
+  }
+
+  void flush() {
+    if (buf.empty()) return;
+    iovec iov = {buf.data(), buf.size()};
+    write_all(&iov, 1);
+    buf.clear();
+  }
+
+  // flushes and closes the file; ok tells whether every byte made it
+  bool close() {
+    if (fd < 0) return ok;
+    flush();
+    if (::close(fd) != 0) ok = false;
+    fd = -1;
+    return ok;
+  }
+
+ private:
+  void write_all(iovec* iov, int n) {
+    while (ok and n > 0) {
+      ssize_t w = writev(fd, iov, n);
+      if (w < 0) {
+        if (errno != EINTR) ok = false;
+        continue;
+      }
+      writes++;
+      for (; n > 0 and (size_t)w >= iov->iov_len; iov++, n--)
+        w -= iov->iov_len;
+      if (n > 0) {
+        iov->iov_base = (char*)iov->iov_base + w;
+        iov->iov_len -= w;
+      }
+    }
+  }
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Runs f(0) ... f(n - 1) on up to jobs threads. Items are handed out one
+// at a time from a shared counter, so uneven items balance themselves.
+template <class F>
+void parallel(int n, int jobs, F f) {
+  atomic<int> next(0);
+  auto worker = [&] {
+    for (int i; (i = next++) < n;) f(i);
+  };
+  vector<thread> threads;
+  for (int t = 1; t < min(n, jobs); t++) threads.emplace_back(worker);
+  worker();
+  for (auto &t : threads) t.join();
+}
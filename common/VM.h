@@ -0,0 +1,146 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Parsed form of the VM language, shared by the translators. Every
+// command becomes a small fixed-size Statement, and label and function
+// names are interned into integer ids, so code generation dispatches on
+// integers instead of comparing strings.
+
+enum class Op : uint8_t {
+  Push, Pop,
+  Add, Sub, Neg, Eq, Gt, Lt, And, Or, Not,
+  Label, Goto, IfGoto, Function, Call, Return
+};
+
+constexpr string_view op_names[] = {
+    "push", "pop",
+    "add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not",
+    "label", "goto", "if-goto", "function", "call", "return"};
+
+// Stack is never parsed: translators use it for the word index places
+// below the stack top, which is how inlined code reaches its arguments.
+enum class Segment : uint8_t {
+  None, Constant, Local, Argument, This, That, Pointer, Temp, Static, Stack
+};
+
+constexpr string_view segment_names[] = {
+    "", "constant", "local", "argument", "this", "that", "pointer", "temp",
+    "static", ""};
+
+struct Statement {
+  Op op;
+  Segment segment = Segment::None;
+  int index = 0;    // segment index, nArgs of a call, nLocals of a function
+  int symbol = -1;  // interned label or function name
+};
+
+// Interned names. A deque keeps every string in place, so the map can
+// key on views of them.
+struct Names {
+  deque<string> names;
+  unordered_map<string_view, int> ids;
+
+  int intern(string_view name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+    names.emplace_back(name);
+    return ids[names.back()] = names.size() - 1;
+  }
+
+  const string& operator[](int id) const { return names[id]; }
+};
+
+template <size_t N>
+int lookup(const string_view (&table)[N], string_view word) {
+  for (size_t i = 0; i < N; i++)
+    if (table[i] == word) return i;
+  return -1;
+}
+
+inline bool is_blank(char c) { return c == ' ' or c == '\t' or c == '\r'; }
+
+// Single pass over the source text. Comments and blank lines are
+// skipped; malformed commands are reported with their line and dropped,
+// and make parse return false.
+inline bool parse(string_view text, Names& names, vector<Statement>& ret,
+                  const string& file = "") {
+  bool ok = true;
+  for (int number = 1; !text.empty(); number++) {
+    size_t eol = text.find('\n');
+    string_view line = text.substr(0, eol);
+    text.remove_prefix(eol == string_view::npos ? text.size() : eol + 1);
+    size_t comment = line.find("//");
+    if (comment != string_view::npos) line = line.substr(0, comment);
+
+    string_view words[3];
+    int n = 0;
+    for (size_t i = 0; i < line.size() and n < 3;) {
+      while (i < line.size() and is_blank(line[i])) i++;
+      size_t j = i;
+      while (j < line.size() and !is_blank(line[j])) j++;
+      if (j > i) words[n++] = line.substr(i, j - i);
+      i = j;
+    }
+    if (n == 0) continue;
+
+    auto fail = [&](const string& msg) {
+      cerr << file << ":" << number << ": " << msg << endl;
+      ok = false;
+    };
+    auto number_at = [&](int k, int& value) {
+      const char* end = words[k].data() + words[k].size();
+      auto [p, ec] = from_chars(words[k].data(), end, value);
+      return k < n and ec == errc() and p == end;
+    };
+
+    int op = lookup(op_names, words[0]);
+    if (op < 0) {
+      fail("unknown command " + string(words[0]));
+      continue;
+    }
+    Statement s;
+    s.op = Op(op);
+    switch (s.op) {
+      case Op::Push:
+      case Op::Pop: {
+        int segment = lookup(segment_names, words[1]);
+        if (n < 3 or segment <= 0 or !number_at(2, s.index)) {
+          fail("bad " + string(words[0]) + " command");
+          continue;
+        }
+        s.segment = Segment(segment);
+        break;
+      }
+      case Op::Label:
+      case Op::Goto:
+      case Op::IfGoto:
+        if (n < 2) {
+          fail(string(words[0]) + " needs a label");
+          continue;
+        }
+        s.symbol = names.intern(words[1]);
+        break;
+      case Op::Function:
+      case Op::Call:
+        if (n < 3 or !number_at(2, s.index)) {
+          fail("bad " + string(words[0]) + " command");
+          continue;
+        }
+        s.symbol = names.intern(words[1]);
+        break;
+      default:
+        break;
+    }
+    ret.emplace_back(s);
+  }
+  return ok;
+}